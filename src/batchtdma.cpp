@@ -0,0 +1,67 @@
+#include "batchtdma.h"
+#include "kernels.h"
+
+// the kernels themselves are in kernelsimpl.h, built once per instruction set
+
+const char* BatchTDMA::isaName()
+{
+	return Kernels::get().name;
+}
+
+void BatchTDMA::solve(const float* a, const float* b, float* c, float* d, float* x, int numRow)
+{
+	Kernels::get().solve(a, b, c, d, x, numRow);
+}
+
+void BatchTDMA::factorize(const float* a, const float* b, const float* c, float* upper, float* pivot, int numRow)
+{
+	Kernels::get().factorize(a, b, c, upper, pivot, numRow);
+}
+
+void BatchTDMA::substitute(const float* a, const float* upper, const float* pivot, float* d, int numRow)
+{
+	Kernels::get().substitute(a, upper, pivot, d, numRow);
+}
+
+void BatchTDMA::substitute(const float* a, const float* upper, const float* pivot, float* d, int numRow, int numRhs)
+{
+	Kernels::get().substituteMany(a, upper, pivot, d, numRow, numRhs);
+}
+
+void BatchTDMA::forwardSubstitute(const float* a, const float* pivot, float* d, int begin, int end)
+{
+	Kernels::get().forwardSubstitute(a, pivot, d, begin, end);
+}
+
+void BatchTDMA::substitute(const WeightType* w, size_t lineStride, int numLines, const float* upper,
+                           const float* pivot, float* d, int numRow, int numRhs)
+{
+	Kernels::get().substituteWeights(w, lineStride, numLines, upper, pivot, d, numRow, numRhs);
+}
+
+void BatchTDMA::forwardSubstitute(const WeightType* w, size_t lineStride, int numLines, const float* pivot, float* d,
+                                  int begin, int end)
+{
+	Kernels::get().forwardSubstituteWeights(w, lineStride, numLines, pivot, d, begin, end);
+}
+
+void BatchTDMA::backwardSubstitute(const float* upper, float* d, int begin, int end, int numRow)
+{
+	Kernels::get().backwardSubstitute(upper, d, begin, end, numRow);
+}
+
+void BatchTDMA::reduceChunk(float* a, const float* b, float* c, float* d, int begin, int end)
+{
+	Kernels::get().reduceChunk(a, b, c, d, begin, end);
+}
+
+void BatchTDMA::solveChunkBorders(const float* a, const float* c, float* d, const int* bounds, int numChunks,
+                                  float* scratch)
+{
+	Kernels::get().solveChunkBorders(a, c, d, bounds, numChunks, scratch);
+}
+
+void BatchTDMA::substituteChunk(const float* a, const float* c, float* d, int begin, int end)
+{
+	Kernels::get().substituteChunk(a, c, d, begin, end);
+}
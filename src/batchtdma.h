@@ -0,0 +1,132 @@
+#ifndef BATCHTDMA_H
+#define BATCHTDMA_H
+
+#include "weighttype.h"
+#include <cstddef>
+
+
+/**
+ * \brief Tridiagonal matrix algorithm solving numLanes independent lines in lockstep,
+ * one line per SIMD lane.
+ *
+ * All arrays use an interleaved layout: element i of the line in lane l is stored
+ * at [i * numLanes + l]. Unused lanes must hold a well-posed system (e.g. a = c = 0, b = 1).
+ * The functions run the variant of the kernels chosen for the processor, see kernels.h.
+ */
+namespace BatchTDMA
+{
+	const int numLanes = 16;
+
+	/**
+	 * \brief name of the instruction set the kernels run with
+	 */
+	const char* isaName();
+
+	/**
+	 * \brief solve the systems in one pass
+	 * \param a :lower
+	 * \param b :central
+	 * \param c :upper, overwritten
+	 * \param d :right vector, overwritten
+	 * \param x :solution
+	 * \param numRow
+	 */
+	void solve(const float* a, const float* b, float* c, float* d, float* x, int numRow);
+
+	/**
+	 * \brief LU factorization for systems whose right vector changes but the matrix does not
+	 * \param a :lower
+	 * \param b :central
+	 * \param c :upper
+	 * \param upper :modified upper diagonal
+	 * \param pivot :reciprocal pivots
+	 * \param numRow
+	 */
+	void factorize(const float* a, const float* b, const float* c, float* upper, float* pivot, int numRow);
+
+	/**
+	 * \brief forward and backward substitution with the factors from factorize
+	 * \param a :lower
+	 * \param upper
+	 * \param pivot
+	 * \param d :right vector, overwritten by the solution
+	 * \param numRow
+	 */
+	void substitute(const float* a, const float* upper, const float* pivot, float* d, int numRow);
+
+	/**
+	 * \brief forward and backward substitution of several right vectors sharing one matrix.
+	 * Node i of vector k in lane l is stored at d[(i * numRhs + k) * numLanes + l], so a sweep
+	 * loads the factors of a node once for all vectors.
+	 * \param a :lower
+	 * \param upper
+	 * \param pivot
+	 * \param d :right vectors, overwritten by the solutions
+	 * \param numRow
+	 * \param numRhs
+	 */
+	void substitute(const float* a, const float* upper, const float* pivot, float* d, int numRow, int numRhs);
+
+	/**
+	 * \brief forward substitution of the nodes [begin, end), continuing from node begin - 1.
+	 * Lets a caller fuse the sweep with building d block by block.
+	 */
+	void forwardSubstitute(const float* a, const float* pivot, float* d, int begin, int end);
+
+	/**
+	 * \brief substitute for PR lines, whose lower diagonal is -w of the edge to the node before
+	 * and is read from the edge weights instead of being stored with the factors
+	 * \param w :edge weights of the first line, w[i] joins node i and i + 1
+	 * \param lineStride :from the weights of one line to those of the next lane
+	 * \param numLines :lanes from numLines on are unused
+	 * \param upper
+	 * \param pivot
+	 * \param d :right vectors, overwritten by the solutions
+	 * \param numRow
+	 * \param numRhs :interleaved as in substitute
+	 */
+	void substitute(const WeightType* w, size_t lineStride, int numLines, const float* upper, const float* pivot,
+	                float* d, int numRow, int numRhs = 1);
+
+	/**
+	 * \brief forwardSubstitute for PR lines, with the lower diagonal read from the edge weights
+	 */
+	void forwardSubstitute(const WeightType* w, size_t lineStride, int numLines, const float* pivot, float* d,
+	                       int begin, int end);
+
+	/**
+	 * \brief backward substitution of the nodes [begin, end), continuing from node end
+	 */
+	void backwardSubstitute(const float* upper, float* d, int begin, int end, int numRow);
+
+	/**
+	 * \brief Partitioned solve of long lines, step 1 of 3: reduce the chunk [begin, end), at least
+	 * 3 nodes long, so that every inner node couples only to the first and the last node of
+	 * the chunk, and those only to each other and to the chunks around. Different chunks of
+	 * the same systems may be reduced at once.
+	 * \param a :lower, overwritten by the coefficient of the first node of the chunk
+	 * \param b :central
+	 * \param c :upper, overwritten by the coefficient of the last node of the chunk
+	 * \param d :right vector, overwritten
+	 * \param begin 
+	 * \param end 
+	 */
+	void reduceChunk(float* a, const float* b, float* c, float* d, int begin, int end);
+
+	/**
+	 * \brief partitioned solve, step 2: solve the first and last nodes of all chunks, which form
+	 * a tridiagonal system of 2 * numChunks nodes. Their solution is written to d.
+	 * \param bounds :numChunks + 1 chunk borders from 0 to the number of nodes
+	 * \param numChunks 
+	 * \param scratch :2 * numChunks * numLanes
+	 */
+	void solveChunkBorders(const float* a, const float* c, float* d, const int* bounds, int numChunks, float* scratch);
+
+	/**
+	 * \brief partitioned solve, step 3: the inner nodes of the chunk [begin, end) from its first
+	 * and last node, d holds the solution of the chunk afterwards
+	 */
+	void substituteChunk(const float* a, const float* c, float* d, int begin, int end);
+}
+
+#endif // BATCHTDMA_H
@@ -1,5 +1,8 @@
 #include "crwcralgorithm.h"
+#include "profiler.h"
 #include <QImage>
+#include <QMutexLocker>
+#include <algorithm>
 #include <array>
 
 
@@ -13,7 +16,7 @@
 template <typename T>
 void medianFilter(T* img, int w, int h)
 {
-	size_t numPixels = w * h;
+	size_t numPixels = size_t(w) * h;
 	int kernelSize = 3;
 
 	T* imgOut = new T[numPixels];
@@ -32,12 +35,12 @@ void medianFilter(T* img, int w, int h)
 			{
 				for (int j = -halfSize; j <= halfSize; j++)
 				{
-					size_t idx = x + i + (y + j) * w;
+					size_t idx = x + i + size_t(y + j) * w;
 					elements[subIdx++] = img[idx];
 				}
 			}
 			std::sort(elements.begin(), elements.end());
-			imgOut[x + y * w] = elements[kernelSize * kernelSize / 2 + 1];
+			imgOut[x + size_t(y) * w] = elements[kernelSize * kernelSize / 2 + 1];
 		}
 	}
 	memcpy(img, imgOut, numPixels * sizeof(T));
@@ -47,20 +50,119 @@ void medianFilter(T* img, int w, int h)
 
 
 CRWCRAlgorithm::CRWCRAlgorithm(QObject* parent)
-	: QObject(parent), solver_(nullptr), isPreProcess_(false), image_(nullptr)
+	: QObject(parent), solver_(nullptr), isPreProcess_(false), hasSolution_(false), image_(nullptr),
+	  processPending_(false), profiledEvents_(0)
 {
 	twoLabelSeed_ = new TwoLabelSeed();
 }
 
+void CRWCRAlgorithm::requestProcess()
+{
+	if (!processPending_)
+	{
+		processPending_ = true;
+		QMetaObject::invokeMethod(this, "process", Qt::QueuedConnection);
+	}
+}
+
+void CRWCRAlgorithm::cancel()
+{
+	// a process still queued by requestProcess returns without solving
+	processPending_ = false;
+
+	QMutexLocker lock(&solverMutex_);
+	if (solver_ != nullptr)
+	{
+		solver_->cancel();
+	}
+}
+
+ProbabilityBuffer& CRWCRAlgorithm::getProbability()
+{
+	return probability_;
+}
+
 void CRWCRAlgorithm::process()
 {
-	// initialize seed buffer
-	twoLabelSeed_->initialize(dim_);
-	solver_->setSeed(twoLabelSeed_);
-	solver_->solve();
+	if (!processPending_.exchange(false) || solver_ == nullptr)
+	{
+		return;
+	}
+
+	// running, the solver reports the real total with its first iteration
+	emit progressChanged(0, 1);
+
+	// the tool panel may change the parameters while the solve runs, it works on a copy
+	const Parameters parameters = Singleton<Parameters>::GetInstance();
+	solver_->setParameters(parameters);
+
+	if (parameters.progressive)
+	{
+		solver_->setIntermediateCallback([this](const float* probability)
+		{
+#if defined(CRWCR_COMPACT_MEMORY) && !defined(USE_GPU)
+			(void)probability;
+			publish(solver_->generateProbabilityImage16());
+#else
+			publish(probability);
+#endif
+			emit segmentationPreview();
+		});
+	}
+	else
+	{
+		solver_->setIntermediateCallback(nullptr);
+	}
+
+	SeedRegion region;
+	if (parameters.incremental && hasSolution_ && twoLabelSeed_->update(dim_, region))
+	{
+		// only strokes were added since the last solve
+		solver_->setSeed(twoLabelSeed_);
+		solver_->solveIncremental(region);
+	}
+	else
+	{
+		// initialize seed buffer
+		twoLabelSeed_->initialize(dim_);
+		solver_->setSeed(twoLabelSeed_);
+		solver_->solve();
+		hasSolution_ = true;
+	}
+
+	if (solver_->isCancelled())
+	{
+		// the solver holds a partial map, the next solve starts over
+		hasSolution_ = false;
+		emit progressChanged(0, 0);
+		return;
+	}
+
+#if defined(CRWCR_COMPACT_MEMORY) && !defined(USE_GPU)
+	publish(solver_->generateProbabilityImage16());
+#else
+	publish(solver_->generateProbabilityImage());
+#endif
+	emit segmentationDone();
+	// PR may have converged before its last iteration
+	emit progressChanged(1, 1);
 
 	emit segmentationTime(solver_->getUseTime());
-	emit segmentationDone(solver_->generateProbabilityImage());
+	if (Profiler::isEnabled())
+	{
+		Profiler& profiler = Singleton<Profiler>::GetInstance();
+		emit segmentationProfile(int(profiledEvents_));
+		profiledEvents_ = profiler.getNumEvents();
+	}
+}
+
+
+void CRWCRAlgorithm::publish(const ProbabilityType* probability)
+{
+	// the canvas reads the front buffer while the solve goes on
+	const size_t numPixels = size_t(dim_.width()) * dim_.height();
+	std::copy(probability, probability + numPixels, probability_.back(numPixels));
+	probability_.swap();
 }
 
 
@@ -78,37 +180,50 @@ CRWCRAlgorithm::~CRWCRAlgorithm()
  * \brief  Set image data
  * \param data 
  */
-void CRWCRAlgorithm::setImage(const QImage& data)
+void CRWCRAlgorithm::setImage(const ImageSource& data)
 {
-	dim_ = QSize(data.width(), data.height());
+	setImage(data.data(), data.bytesPerLine(), data.size(), data.format());
+}
 
-	delete[] image_;
+void CRWCRAlgorithm::setImage(const void* data, size_t bytesPerLine, QSize dim, ImageConversion::PixelFormat format)
+{
+	dim_ = dim;
 
-	image_ = new float[dim_.width() * dim_.height()];
+	// the trace covers the current image, from its weights on
+	Singleton<Profiler>::GetInstance().clear();
+	profiledEvents_ = 0;
 
-	for (int x = 0; x < dim_.width(); x++)
-	{
-		for (int y = 0; y < dim_.height(); y++)
-		{
-			QColor col = data.pixelColor(x, y);
+	delete[] image_;
 
-			//rgb2gray: 0.2989 * R + 0.5870 * G + 0.1140 * B 
-			// normalize to [0,1]
-			image_[x + dim_.width() * y] = (0.2989 * col.red() + 0.5870 * col.green() + 0.1140 * col.blue()) / 255;
-		}
-	}
+	image_ = new float[size_t(dim_.width()) * dim_.height()];
+
+	ImageConversion::toGray(data, bytesPerLine, dim_.width(), dim_.height(), format, image_,
+	                        Singleton<Parameters>::GetInstance().numThreads);
 
 	if (isPreProcess_)
 	{
 		medianFilter(image_, dim_.width(), dim_.height());
 	}
 
+	// the maps of the last image do not fit this one
+	probability_.clear();
+
+	CRWCRSolver* solver = new CRWCRSolver(image_, dim_.width(), dim_.height());
+	solver->setProgressCallback([this](int done, int total) { emit progressChanged(done, total); });
+
+	QMutexLocker lock(&solverMutex_);
 	delete solver_;
-	solver_ = nullptr;
-	solver_ = new CRWCRSolver(image_, dim_.width(), dim_.height());
+	solver_ = solver;
+	hasSolution_ = false;
 }
 
 void CRWCRAlgorithm::setSeeds(const PointListGeometry& foregroundseed, const PointListGeometry& backgroundseed)
 {
 	twoLabelSeed_->setSeeds(foregroundseed, backgroundseed);
+
+	// a new stroke is cheap to fold in, give feedback right away
+	if (Singleton<Parameters>::GetInstance().incremental && hasSolution_)
+	{
+		requestProcess();
+	}
 }
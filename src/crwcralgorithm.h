@@ -8,12 +8,25 @@
 #endif
 
 #include "twolabelseed.h"
+#include "imagesource.h"
+#include "doublebuffer.h"
+#include <QMutex>
 #include <QObject>
 #include <QSizeF>
+#include <atomic>
+
+#if defined(CRWCR_COMPACT_MEMORY) && !defined(USE_GPU)
+// the compact build hands the probability map over in 16-bit fixed point
+typedef unsigned short ProbabilityType;
+#else
+typedef float ProbabilityType;
+#endif
+typedef DoubleBuffer<ProbabilityType> ProbabilityBuffer;
 
 
 /**
- * \brief CRWCR algorithm
+ * \brief CRWCR algorithm, meant to live on a worker thread. Its slots run there through queued
+ * connections, except cancel, which any thread may call while a solve is running.
  */
 class CRWCRAlgorithm : public QObject
 {
@@ -22,15 +35,56 @@ public:
 	explicit CRWCRAlgorithm(QObject* parent = nullptr);
 	~CRWCRAlgorithm();
 
-	void setImage(const QImage& data);
+	void setImage(const ImageSource& data);
+
+	/**
+	 * \brief set image data from a buffer, e.g. a 16-bit gray or float image that QImage does not hold
+	 * \param data :first row
+	 * \param bytesPerLine 
+	 * \param dim 
+	 * \param format 
+	 */
+	void setImage(const void* data, size_t bytesPerLine, QSize dim, ImageConversion::PixelFormat format);
+
+	/**
+	 * \brief stop the running solve, its result is dropped, and drop a solve still queued by
+	 * requestProcess. Callable from any thread.
+	 */
+	void cancel();
+
+	/**
+	 * \brief the probability maps, published before segmentationDone and segmentationPreview.
+	 * Lock the front one to read it.
+	 */
+	ProbabilityBuffer& getProbability();
 
 signals:
 
-	void segmentationDone(float*);
-	void segmentationTime(int);
+	// a new probability map is the front of getProbability
+	void segmentationDone();
+	// an intermediate map of the running solve is the front of getProbability, see Parameters::progressive
+	void segmentationPreview();
+	void segmentationTime(float);
+	/**
+	 * \brief iterations done of the running solve, total 0 once a solve is cancelled
+	 */
+	void progressChanged(int done, int total);
+	/**
+	 * \brief the phases recorded by the profiler since the last emission start at firstEvent,
+	 * emitted by profiling builds only
+	 */
+	void segmentationProfile(int firstEvent);
 
 public slots:
 
+	/**
+	 * \brief solve once the events queued before are handled, requests arriving until then share that solve
+	 */
+	void requestProcess();
+
+	/**
+	 * \brief the solve queued by requestProcess, nothing if cancel ran in between
+	 */
 	void process();
 
 	void setSeeds(const PointListGeometry& foregroundseed, const PointListGeometry& backgroundseed);
@@ -41,12 +95,28 @@ public slots:
 	}
 
 private:
+	/**
+	 * \brief copy a probability map of the current image into the back buffer and swap it to the front
+	 */
+	void publish(const ProbabilityType* probability);
+
 	TwoLabelSeed* twoLabelSeed_;
 	CRWCRSolver* solver_;
 
 	bool isPreProcess_;
+	// the solver holds a result of the current image and seed buffer to continue from
+	bool hasSolution_;
 	float* image_;
 	QSize dim_;
+
+	// guards replacing solver_ against cancel from other threads
+	QMutex solverMutex_;
+	// a process is queued by requestProcess, cleared by cancel from any thread
+	std::atomic<bool> processPending_;
+	ProbabilityBuffer probability_;
+
+	// profiler events already reported through segmentationProfile
+	size_t profiledEvents_;
 };
 
 #endif  // CRWCRALGORITHM_H
@@ -0,0 +1,443 @@
+#include "crwcrsolver.h"
+#include "imagesource.h"
+#include "profiler.h"
+#include <QDir>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * \brief End-to-end benchmark of the solver on the bundled test images and on synthetic images
+ * of the README sizes up to 8192 x 8192, all with fixed seed masks. Every case is solved
+ * repeatedly and the median and p99 wall time of each phase are reported, per image and per
+ * pixel, on the console and as CSV. Profiling builds add the solver phases recorded by the
+ * profiler. A CSV of an earlier version can be given as baseline to flag slower phases.
+ */
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	struct Case
+	{
+		std::string name;
+		int width, height;
+		// source pixels of file cases, empty for synthetic ones
+		std::string path;
+	};
+
+	struct Statistics
+	{
+		double median, p99, min;
+	};
+
+	struct Result
+	{
+		Case input;
+		int iterations;
+		// in the order the phases first ran
+		std::vector<std::pair<std::string, Statistics>> phases;
+	};
+
+	/**
+	 * \brief times of each phase over the runs of a case, in the order the phases first ran
+	 */
+	class PhaseTimes
+	{
+	public:
+		void add(const std::string& phase, double time)
+		{
+			auto p = std::find_if(times_.begin(), times_.end(),
+			                      [&](const std::pair<std::string, std::vector<double>>& t) { return t.first == phase; });
+			if (p == times_.end())
+			{
+				times_.emplace_back(phase, std::vector<double>());
+				p = times_.end() - 1;
+			}
+			p->second.push_back(time);
+		}
+
+		const std::vector<std::pair<std::string, std::vector<double>>>& get() const
+		{
+			return times_;
+		}
+
+	private:
+		std::vector<std::pair<std::string, std::vector<double>>> times_;
+	};
+
+	void printUsage()
+	{
+		printf(
+			"usage: crwcr_bench [options]\n"
+			"\n"
+			"options:\n"
+			"  -n N              timed runs per case, default 10\n"
+			"  -w N              untimed warm-up runs per case, default 1\n"
+			"  -t N              solver threads, default all cores\n"
+			"  --images DIR      test images, default \"test image\", \"\" skips them\n"
+			"  --max-size N      largest side of the synthetic images, default 8192, 0 skips them\n"
+			"  --csv FILE        write the results as CSV\n"
+			"  --baseline FILE   compare the medians with the CSV of an earlier run\n"
+			"  --tolerance P     percent a median may grow over the baseline, default 10\n");
+	}
+
+	double milliseconds(Clock::time_point start, Clock::time_point stop)
+	{
+		return std::chrono::duration<double, std::milli>(stop - start).count();
+	}
+
+	/**
+	 * \brief median, nearest-rank p99 and minimum of times
+	 */
+	Statistics statistics(std::vector<double> times)
+	{
+		std::sort(times.begin(), times.end());
+		const size_t n = times.size();
+
+		Statistics s;
+		s.median = n % 2 ? times[n / 2] : 0.5 * (times[n / 2 - 1] + times[n / 2]);
+		s.p99 = times[size_t(std::ceil(0.99 * n)) - 1];
+		s.min = times.front();
+		return s;
+	}
+
+	/**
+	 * \brief bright disc on a shaded background with a little noise, the same for every run
+	 */
+	void syntheticImage(int width, int height, float* image)
+	{
+#pragma omp parallel for
+		for (int y = 0; y < height; y++)
+		{
+			unsigned state = 1 + y;
+			for (int x = 0; x < width; x++)
+			{
+				const float dx = x - width * 0.5f, dy = y - height * 0.5f;
+				const bool inside = dx * dx + dy * dy < 0.09f * width * height;
+
+				state = state * 1103515245 + 12345;
+				const float noise = ((state >> 16) & 1023) / 1023.f * 0.01f;
+				image[x + size_t(y) * width] = (inside ? 0.7f : 0.2f) + noise + 0.1f * std::sin(x * 0.05f);
+			}
+		}
+	}
+
+	/**
+	 * \brief fixed seed mask: a foreground cross in the middle, a fifth of the shorter side long,
+	 * and the background frame 2% inside the border
+	 */
+	void fixedSeeds(int width, int height, unsigned char* labels)
+	{
+		std::fill(labels, labels + size_t(width) * height, 0);
+
+		const int cx = width / 2, cy = height / 2, arm = std::min(width, height) / 10;
+		for (int i = -arm; i <= arm; i++)
+		{
+			labels[cx + i + size_t(cy) * width] = 1;
+			labels[cx + size_t(cy + i) * width] = 1;
+		}
+
+		const int x0 = width / 50, y0 = height / 50, x1 = width - 1 - x0, y1 = height - 1 - y0;
+		for (int x = x0; x <= x1; x++)
+		{
+			labels[x + size_t(y0) * width] = 2;
+			labels[x + size_t(y1) * width] = 2;
+		}
+		for (int y = y0; y <= y1; y++)
+		{
+			labels[x0 + size_t(y) * width] = 2;
+			labels[x1 + size_t(y) * width] = 2;
+		}
+	}
+
+	std::vector<Case> imageCases(const std::string& directory)
+	{
+		std::vector<Case> cases;
+		if (directory.empty())
+		{
+			return cases;
+		}
+
+		const QDir dir(QString::fromStdString(directory));
+		for (const QString& file : dir.entryList({"*.png", "*.jpg", "*.bmp"}, QDir::Files, QDir::Name))
+		{
+			ImageSource image;
+			if (image.load(dir.filePath(file)))
+			{
+				cases.push_back({file.toStdString(), image.size().width(), image.size().height(),
+				                 dir.filePath(file).toStdString()});
+			}
+		}
+		return cases;
+	}
+
+	std::vector<Case> syntheticCases(int maxSize)
+	{
+		// the sizes of the README table, then square powers of two
+		const int sizes[][2] = {
+			{481, 321}, {680, 669}, {1024, 1024}, {1443, 963}, {1924, 1284}, {2048, 2048}, {4096, 4096}, {8192, 8192}
+		};
+
+		std::vector<Case> cases;
+		for (const auto& size : sizes)
+		{
+			if (std::max(size[0], size[1]) <= maxSize)
+			{
+				cases.push_back({"synthetic", size[0], size[1], std::string()});
+			}
+		}
+		return cases;
+	}
+
+	Result run(const Case& input, int numRuns, int numWarmup, int numThreads)
+	{
+		const size_t numPixels = size_t(input.width) * input.height;
+		std::vector<float> image(numPixels);
+		std::vector<unsigned char> labels(numPixels);
+		PhaseTimes times;
+
+		ImageSource source;
+		if (!input.path.empty())
+		{
+			source.load(QString::fromStdString(input.path));
+		}
+		else
+		{
+			syntheticImage(input.width, input.height, image.data());
+		}
+
+		Result result;
+		result.input = input;
+		result.iterations = 0;
+
+		for (int run = 0; run < numWarmup + numRuns; run++)
+		{
+			Singleton<Profiler>::GetInstance().clear();
+
+			const auto start = Clock::now();
+			if (!source.isNull())
+			{
+				ImageConversion::toGray(source.data(), source.bytesPerLine(), input.width, input.height,
+				                        source.format(), image.data(), numThreads);
+			}
+			const auto converted = Clock::now();
+
+			CRWCRSolver solver(image.data(), input.width, input.height);
+			const auto setup = Clock::now();
+
+			fixedSeeds(input.width, input.height, labels.data());
+			SeedBuffer seeds(labels.data(), input.width, input.height);
+			solver.setSeed(&seeds);
+			const auto seeded = Clock::now();
+
+			solver.solve();
+			const auto solved = Clock::now();
+
+			if (run < numWarmup)
+			{
+				continue;
+			}
+
+			if (!source.isNull())
+			{
+				times.add("convert", milliseconds(start, converted));
+			}
+			times.add("setup", milliseconds(converted, setup));
+			times.add("seeds", milliseconds(setup, seeded));
+			times.add("solve", milliseconds(seeded, solved));
+			times.add("total", milliseconds(start, solved));
+
+			// the solver phases inside setup and solve, solve itself is timed above
+			for (const auto& phase : Singleton<Profiler>::GetInstance().getSummary(0))
+			{
+				if (phase.first != "solve")
+				{
+					times.add(phase.first, phase.second);
+				}
+			}
+			result.iterations = solver.getIterations();
+		}
+
+		for (const auto& phase : times.get())
+		{
+			result.phases.emplace_back(phase.first, statistics(phase.second));
+		}
+		return result;
+	}
+
+	std::string caseKey(const std::string& name, int width, int height, const std::string& phase)
+	{
+		return name + " " + std::to_string(width) + "x" + std::to_string(height) + " " + phase;
+	}
+
+	bool writeCsv(const std::string& path, const std::vector<Result>& results, int numThreads)
+	{
+		std::ofstream file(path);
+		if (!file)
+		{
+			return false;
+		}
+
+		file << "name,width,height,threads,iterations,phase,median_ms,p99_ms,min_ms,median_ns_per_pixel\n";
+		for (const auto& r : results)
+		{
+			const double numPixels = double(r.input.width) * r.input.height;
+			for (const auto& phase : r.phases)
+			{
+				const Statistics& s = phase.second;
+				file << r.input.name << ',' << r.input.width << ',' << r.input.height << ',' << numThreads << ','
+					<< r.iterations << ',' << phase.first << ',' << s.median << ',' << s.p99 << ',' << s.min << ','
+					<< s.median * 1e6 / numPixels << '\n';
+			}
+		}
+		return bool(file);
+	}
+
+	/**
+	 * \brief medians of a CSV written by writeCsv, by caseKey
+	 */
+	bool readBaseline(const std::string& path, std::map<std::string, double>& medians)
+	{
+		std::ifstream file(path);
+		if (!file)
+		{
+			return false;
+		}
+
+		std::string line;
+		std::getline(file, line);
+		while (std::getline(file, line))
+		{
+			std::vector<std::string> fields;
+			std::istringstream stream(line);
+			std::string field;
+			while (std::getline(stream, field, ','))
+			{
+				fields.push_back(field);
+			}
+			if (fields.size() >= 7)
+			{
+				medians[caseKey(fields[0], atoi(fields[1].c_str()), atoi(fields[2].c_str()), fields[5])] =
+					atof(fields[6].c_str());
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int numRuns = 10, numWarmup = 1, maxSize = 8192;
+	float tolerance = 10;
+	std::string imageDirectory = "test image", csvPath, baselinePath;
+	Parameters& parameters = Singleton<Parameters>::GetInstance();
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		if (i + 1 >= argc)
+		{
+			printUsage();
+			return 2;
+		}
+
+		if (arg == "-n")
+		{
+			numRuns = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "-w")
+		{
+			numWarmup = std::max(0, atoi(argv[++i]));
+		}
+		else if (arg == "-t")
+		{
+			parameters.numThreads = atoi(argv[++i]);
+		}
+		else if (arg == "--images")
+		{
+			imageDirectory = argv[++i];
+		}
+		else if (arg == "--max-size")
+		{
+			maxSize = atoi(argv[++i]);
+		}
+		else if (arg == "--csv")
+		{
+			csvPath = argv[++i];
+		}
+		else if (arg == "--baseline")
+		{
+			baselinePath = argv[++i];
+		}
+		else if (arg == "--tolerance")
+		{
+			tolerance = float(atof(argv[++i]));
+		}
+		else
+		{
+			printUsage();
+			return 2;
+		}
+	}
+
+	std::map<std::string, double> baseline;
+	if (!baselinePath.empty() && !readBaseline(baselinePath, baseline))
+	{
+		fprintf(stderr, "cannot read %s\n", baselinePath.c_str());
+		return 2;
+	}
+
+	std::vector<Case> cases = imageCases(imageDirectory);
+	const std::vector<Case> synthetic = syntheticCases(maxSize);
+	cases.insert(cases.end(), synthetic.begin(), synthetic.end());
+
+	printf("%d runs per case, %d 1D and %d PR iterations, %d pyramid levels\n\n", numRuns,
+	       parameters.maxIterations1D, parameters.maxIterations2D, parameters.pyramidLevels);
+	printf("%-28s %-34s %10s %10s %10s %12s\n", "case", "phase", "median ms", "p99 ms", "min ms", "ns/pixel");
+
+	std::vector<Result> results;
+	int regressions = 0;
+	for (const auto& input : cases)
+	{
+		results.push_back(run(input, numRuns, numWarmup, parameters.numThreads));
+		const Result& r = results.back();
+
+		const std::string label = input.name + " " + std::to_string(input.width) + "x" + std::to_string(input.height);
+		for (const auto& phase : r.phases)
+		{
+			const Statistics& s = phase.second;
+			printf("%-28s %-34s %10.2f %10.2f %10.2f %12.2f", label.c_str(), phase.first.c_str(), s.median, s.p99,
+			       s.min, s.median * 1e6 / (double(input.width) * input.height));
+
+			auto old = baseline.find(caseKey(input.name, input.width, input.height, phase.first));
+			if (old != baseline.end() && old->second > 0)
+			{
+				const double change = (s.median / old->second - 1) * 100;
+				const bool slower = change > tolerance;
+				regressions += slower;
+				printf("  %+6.1f%%%s", change, slower ? "  SLOWER" : "");
+			}
+			printf("\n");
+		}
+	}
+
+	if (!csvPath.empty() && !writeCsv(csvPath, results, parameters.numThreads))
+	{
+		fprintf(stderr, "cannot write %s\n", csvPath.c_str());
+		return 2;
+	}
+
+	if (regressions > 0)
+	{
+		printf("\n%d phase medians more than %.0f%% slower than the baseline\n", regressions, tolerance);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,484 @@
+#include "crwcrsolver.h"
+#include "crwcrtiledsolver.h"
+#include "crwcrslabsolver.h"
+#include "imagesource.h"
+#include "seedbuffer.h"
+#include "workstealingpool.h"
+#include <QImage>
+#include <QFileInfo>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Headless batch segmentation. Solves a list of images concurrently without a
+ * QApplication or an OpenGL context and reports the throughput.
+ */
+namespace
+{
+	struct Job
+	{
+		std::string image, seeds, output;
+	};
+
+	void printUsage()
+	{
+		printf(
+			"usage: crwcr_cli [options] <job list>\n"
+			"\n"
+			"The job list has one image per line: <image> <seeds> <output>\n"
+			"  image   an image file, or *.raw with a sidecar *.raw.hdr (\"width height uint8|uint16|float32\")\n"
+			"  seeds   *.txt with one stroke per line, \"f\" or \"b\" followed by x y pairs, or an 8-bit\n"
+			"          label image or *.raw of the image size, 0: none, 1: foreground, 2: background,\n"
+			"          or 1 to N for N > 2 labels segmented together\n"
+			"  output  *.raw for the float32 probability map, any other extension for an 8-bit image.\n"
+			"          With more than two labels the label of every pixel, *.raw as uint8\n"
+			"\n"
+			"options:\n"
+			"  -j N      images solved concurrently, default one per core\n"
+			"  -t N      threads per image, default 1\n"
+			"  --mask T  write the mask of probability >= T instead of the probability map, two labels only\n"
+			"  --tile-memory MB\n"
+			"            solve tile by tile in about MB of memory per image. The image must be a float32\n"
+			"            *.raw with header, the seeds a *.raw label file and the output *.raw\n"
+			"  --volume  every job is a volume solved in 3D slab by slab: a float32 *.raw with a sidecar\n"
+			"            *.raw.hdr (\"width height depth float32\"), a uint8 *.raw label volume and a\n"
+			"            float32 *.raw output, slices one after the other. --tile-memory sets the memory\n"
+			"            of a slab\n");
+	}
+
+	bool readJobs(const std::string& path, std::vector<Job>& jobs)
+	{
+		std::ifstream file(path);
+		if (!file)
+		{
+			return false;
+		}
+
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream fields(line);
+			Job job;
+			if (fields >> job.image >> job.seeds >> job.output)
+			{
+				jobs.push_back(job);
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * \brief draw the strokes of a text file into seeds, the background after the foreground
+	 */
+	bool readStrokes(const std::string& path, SeedBuffer& seeds)
+	{
+		std::ifstream file(path);
+		if (!file)
+		{
+			return false;
+		}
+
+		// x y pairs of every stroke, foreground strokes first
+		std::vector<std::vector<int>> strokes[2];
+
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream fields(line);
+			std::string label;
+			if (!(fields >> label))
+			{
+				continue;
+			}
+
+			std::vector<int> stroke;
+			int x, y;
+			while (fields >> x >> y)
+			{
+				stroke.push_back(x);
+				stroke.push_back(y);
+			}
+
+			if (label == "f")
+			{
+				strokes[0].push_back(stroke);
+			}
+			else if (label == "b")
+			{
+				strokes[1].push_back(stroke);
+			}
+			else
+			{
+				return false;
+			}
+		}
+
+		SeedRegion region = {seeds.getWidth(), seeds.getHeight(), 0, 0};
+		for (int k = 0; k < 2; k++)
+		{
+			for (const std::vector<int>& stroke : strokes[k])
+			{
+				const size_t numPoints = stroke.size() / 2;
+				if (numPoints == 0)
+				{
+					continue;
+				}
+
+				// a line from every point to the next, a single point is a line to itself
+				for (size_t j = 0; j < std::max(numPoints, size_t(2)) - 1; j++)
+				{
+					const size_t next = std::min(j + 1, numPoints - 1);
+					seeds.drawLine(stroke[2 * j], stroke[2 * j + 1], stroke[2 * next], stroke[2 * next + 1],
+					               static_cast<unsigned char>(k + 1), region);
+				}
+			}
+		}
+		return true;
+	}
+
+	bool openImage(const std::string& path, ImageSource& image)
+	{
+		const QString name = QString::fromStdString(path);
+		if (QFileInfo(name).suffix().compare("raw", Qt::CaseInsensitive) != 0)
+		{
+			return image.load(name);
+		}
+
+		QSize dim;
+		ImageConversion::PixelFormat format;
+		return ImageSource::readRawHeader(name, dim, format) && image.loadRaw(name, dim, format);
+	}
+
+	bool readSeeds(const std::string& path, QSize dim, SeedBuffer& seeds)
+	{
+		const QString name = QString::fromStdString(path);
+
+		if (QFileInfo(name).suffix().compare("txt", Qt::CaseInsensitive) == 0)
+		{
+			seeds.allocate(dim.width(), dim.height());
+			return readStrokes(path, seeds);
+		}
+
+		// label files without sidecar header have the size of the image
+		ImageSource labels;
+		if (QFileInfo(name).suffix().compare("raw", Qt::CaseInsensitive) == 0 && !QFileInfo(name + ".hdr").exists())
+		{
+			labels.loadRaw(name, dim, ImageConversion::PixelFormat::Gray8);
+		}
+		else
+		{
+			openImage(path, labels);
+		}
+
+		if (labels.isNull() || labels.size() != dim || labels.format() != ImageConversion::PixelFormat::Gray8)
+		{
+			return false;
+		}
+
+		std::vector<unsigned char> buffer(size_t(dim.width()) * dim.height());
+		const unsigned char* data = static_cast<const unsigned char*>(labels.data());
+		for (int y = 0; y < dim.height(); y++)
+		{
+			std::copy(data + y * labels.bytesPerLine(), data + y * labels.bytesPerLine() + dim.width(),
+			          buffer.begin() + size_t(y) * dim.width());
+		}
+		seeds.assign(buffer.data(), dim.width(), dim.height());
+		return true;
+	}
+
+	bool writeOutput(const std::string& path, const float* probability, QSize dim, float threshold)
+	{
+		const size_t numPixels = size_t(dim.width()) * dim.height();
+		const QString name = QString::fromStdString(path);
+
+		if (QFileInfo(name).suffix().compare("raw", Qt::CaseInsensitive) == 0)
+		{
+			std::vector<float> values(probability, probability + numPixels);
+			if (threshold >= 0)
+			{
+				for (auto& v : values)
+				{
+					v = v >= threshold ? 1.f : 0.f;
+				}
+			}
+
+			FILE* file = fopen(path.c_str(), "wb");
+			if (file == nullptr)
+			{
+				return false;
+			}
+			const bool written = fwrite(values.data(), sizeof(float), numPixels, file) == numPixels;
+			return fclose(file) == 0 && written;
+		}
+
+		QImage image(dim, QImage::Format_Grayscale8);
+		for (int y = 0; y < dim.height(); y++)
+		{
+			unsigned char* row = image.scanLine(y);
+			const float* p = probability + size_t(y) * dim.width();
+			for (int x = 0; x < dim.width(); x++)
+			{
+				const float v = threshold >= 0 ? (p[x] >= threshold ? 1.f : 0.f) : std::min(std::max(p[x], 0.f), 1.f);
+				row[x] = static_cast<unsigned char>(v * 255 + 0.5f);
+			}
+		}
+		return image.save(name);
+	}
+
+	/**
+	 * \brief write the label of every pixel, raw or as 8-bit image
+	 */
+	bool writeLabels(const std::string& path, const unsigned char* labels, QSize dim)
+	{
+		const size_t numPixels = size_t(dim.width()) * dim.height();
+		const QString name = QString::fromStdString(path);
+
+		if (QFileInfo(name).suffix().compare("raw", Qt::CaseInsensitive) == 0)
+		{
+			FILE* file = fopen(path.c_str(), "wb");
+			if (file == nullptr)
+			{
+				return false;
+			}
+			const bool written = fwrite(labels, 1, numPixels, file) == numPixels;
+			return fclose(file) == 0 && written;
+		}
+
+		QImage image(dim, QImage::Format_Grayscale8);
+		for (int y = 0; y < dim.height(); y++)
+		{
+			std::copy(labels + size_t(y) * dim.width(), labels + size_t(y + 1) * dim.width(), image.scanLine(y));
+		}
+		return image.save(name);
+	}
+
+	bool isRaw(const std::string& path)
+	{
+		return QFileInfo(QString::fromStdString(path)).suffix().compare("raw", Qt::CaseInsensitive) == 0;
+	}
+
+	/**
+	 * \brief solve one job tile by tile, the files are mapped instead of read
+	 * \return empty on success, otherwise what went wrong
+	 */
+	std::string solveTiled(const Job& job, size_t& numPixels, double& solveTime)
+	{
+		QSize dim;
+		ImageConversion::PixelFormat format;
+		if (!isRaw(job.image) || !ImageSource::readRawHeader(QString::fromStdString(job.image), dim, format) ||
+			format != ImageConversion::PixelFormat::Float32)
+		{
+			return "tiles need a float32 raw image with header, not " + job.image;
+		}
+		if (!isRaw(job.seeds) || !isRaw(job.output))
+		{
+			return "tiles need raw seeds and output";
+		}
+
+		CRWCRTiledSolver solver(dim.width(), dim.height());
+		if (!solver.solve(job.image, job.seeds, job.output))
+		{
+			return "cannot map " + job.seeds + " or " + job.output;
+		}
+
+		solveTime = solver.getUseTime();
+		numPixels = size_t(dim.width()) * dim.height();
+		return std::string();
+	}
+
+	/**
+	 * \brief read the sidecar header "width height depth float32" of a raw volume
+	 */
+	bool readVolumeHeader(const std::string& path, int& width, int& height, int& depth)
+	{
+		std::ifstream file(path + ".hdr");
+		std::string type;
+		return file >> width >> height >> depth >> type && type == "float32" && width > 1 && height > 1 && depth > 1;
+	}
+
+	/**
+	 * \brief solve one volume job slab by slab, the files are mapped instead of read
+	 * \return empty on success, otherwise what went wrong
+	 */
+	std::string solveVolume(const Job& job, size_t& numVoxels, double& solveTime)
+	{
+		int width, height, depth;
+		if (!isRaw(job.image) || !readVolumeHeader(job.image, width, height, depth))
+		{
+			return "volumes need a float32 raw volume with header, not " + job.image;
+		}
+		if (!isRaw(job.seeds) || !isRaw(job.output))
+		{
+			return "volumes need raw seeds and output";
+		}
+
+		CRWCRSlabSolver solver(width, height, depth);
+		if (!solver.solve(job.image, job.seeds, job.output))
+		{
+			return "cannot map " + job.seeds + " or " + job.output;
+		}
+
+		solveTime = solver.getUseTime();
+		numVoxels = size_t(width) * height * depth;
+		return std::string();
+	}
+
+	/**
+	 * \brief solve one job
+	 * \return empty on success, otherwise what went wrong
+	 */
+	std::string solve(const Job& job, float threshold, int numThreads, size_t& numPixels, double& solveTime)
+	{
+		ImageSource source;
+		if (!openImage(job.image, source))
+		{
+			return "cannot read image " + job.image;
+		}
+
+		const QSize dim = source.size();
+		std::vector<float> image(size_t(dim.width()) * dim.height());
+		ImageConversion::toGray(source.data(), source.bytesPerLine(), dim.width(), dim.height(), source.format(),
+		                        image.data(), numThreads);
+
+		SeedBuffer seeds;
+		if (!readSeeds(job.seeds, dim, seeds))
+		{
+			return "cannot read seeds " + job.seeds;
+		}
+
+		// label images with more labels than foreground and background are segmented into all at once
+		const unsigned char* labels = seeds.getSeedBuffer();
+		const int numLabels = *std::max_element(labels, labels + image.size());
+
+		auto start = std::chrono::steady_clock::now();
+
+		CRWCRSolver solver(image.data(), dim.width(), dim.height());
+		if (numLabels > 2)
+		{
+			solver.solveMultiLabel(&seeds, numLabels);
+		}
+		else
+		{
+			solver.setSeed(&seeds);
+			solver.solve();
+		}
+
+		solveTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		numPixels = image.size();
+
+		const bool written = numLabels > 2 ? writeLabels(job.output, solver.generateLabelImage(), dim) :
+			writeOutput(job.output, solver.generateProbabilityImage(), dim, threshold);
+		if (!written)
+		{
+			return "cannot write " + job.output;
+		}
+		return std::string();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int numWorkers = 0, numThreads = 1, tileMemory = 0;
+	float threshold = -1;
+	bool volume = false;
+	std::string listPath;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		if (arg == "-j" && i + 1 < argc)
+		{
+			numWorkers = atoi(argv[++i]);
+		}
+		else if (arg == "-t" && i + 1 < argc)
+		{
+			numThreads = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--mask" && i + 1 < argc)
+		{
+			threshold = float(atof(argv[++i]));
+		}
+		else if (arg == "--tile-memory" && i + 1 < argc)
+		{
+			tileMemory = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--volume")
+		{
+			volume = true;
+		}
+		else if (listPath.empty() && arg[0] != '-')
+		{
+			listPath = arg;
+		}
+		else
+		{
+			printUsage();
+			return 2;
+		}
+	}
+
+	std::vector<Job> jobs;
+	if (listPath.empty())
+	{
+		printUsage();
+		return 2;
+	}
+	if (!readJobs(listPath, jobs))
+	{
+		fprintf(stderr, "cannot read %s\n", listPath.c_str());
+		return 2;
+	}
+
+	// every solve runs its sweeps on its own numThreads threads
+	Singleton<Parameters>::GetInstance().numThreads = numThreads;
+	if (tileMemory > 0)
+	{
+		Singleton<Parameters>::GetInstance().tileMemoryMB = tileMemory;
+	}
+
+	WorkStealingPool pool(numWorkers);
+	std::atomic<size_t> totalPixels(0);
+	std::atomic<int> failed(0);
+	std::vector<double> solveTimes(jobs.size(), 0);
+	double totalSolveTime = 0;
+	std::mutex outputMutex;
+
+	auto start = std::chrono::steady_clock::now();
+
+	pool.run(jobs.size(), [&](size_t index, int)
+	{
+		size_t numPixels = 0;
+		const std::string error = volume ? solveVolume(jobs[index], numPixels, solveTimes[index]) :
+			tileMemory > 0 ? solveTiled(jobs[index], numPixels, solveTimes[index]) :
+			solve(jobs[index], threshold, numThreads, numPixels, solveTimes[index]);
+
+		std::lock_guard<std::mutex> lock(outputMutex);
+		if (error.empty())
+		{
+			totalPixels += numPixels;
+			totalSolveTime += solveTimes[index];
+			printf("%s: %zu pixels, %.1f ms\n", jobs[index].image.c_str(), numPixels, solveTimes[index]);
+		}
+		else
+		{
+			failed++;
+			fprintf(stderr, "%s: %s\n", jobs[index].image.c_str(), error.c_str());
+		}
+	});
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	const size_t solved = jobs.size() - failed;
+	printf("%zu of %zu images in %.2f s on %d workers x %d threads: %.2f images/s, %.2f MP/s, %.1f ms mean solve\n",
+	       solved, jobs.size(), seconds, pool.getNumThreads(), numThreads, solved / seconds,
+	       totalPixels / seconds * 1e-6, solved > 0 ? totalSolveTime / solved : 0.0);
+
+	return failed > 0 ? 1 : 0;
+}
@@ -4,12 +4,16 @@
 
 #pragma comment(lib, "cudart.lib")
 
-CRWCRSolver::CRWCRSolver(const float * image, int width, int height) :
+CRWCRSolver::CRWCRSolver(const float * image, int width, int height, float* probability) :
 	image_(image),
 	width_(width),
 	height_(height),
 	seeds_(nullptr),
-	parameters_(Singleton<Parameters>::GetInstance())
+	parameters_(Singleton<Parameters>::GetInstance()),
+	solution_(probability),
+	ownsSolution_(probability == nullptr),
+	probability16_(nullptr),
+	cancelled_(false)
 {
 	numPixels_ = width_ * height_;
 	
@@ -23,7 +27,10 @@ CRWCRSolver::CRWCRSolver(const float * image, int width, int height) :
 	cudaMalloc((void**)&d_rVec, numPixels_ * sizeof(float));
 	cudaMalloc((void**)&d_solution, numPixels_ * sizeof(float));
 
-	solution_ = new float[numPixels_];
+	if (ownsSolution_)
+	{
+		solution_ = new float[numPixels_];
+	}
 
 	calculateWeight();
 	calculateGradient();
@@ -40,17 +47,55 @@ CRWCRSolver::~CRWCRSolver()
 	cudaFree(d_matSub);
 	cudaFree(d_rVec);
 	cudaFree(d_seedBuffer_);
-	delete[] solution_;
+	if (ownsSolution_)
+	{
+		delete[] solution_;
+	}
 	solution_ = nullptr;
+	delete[] probability16_;
 }
 
-void CRWCRSolver::setSeed(TwoLabelSeed * seed)
+void CRWCRSolver::setSeed(SeedBuffer * seed)
 {
 	seeds_ = seed;
 }
 
+void CRWCRSolver::setParameters(const Parameters& parameters)
+{
+	parameters_ = parameters;
+}
+
+void CRWCRSolver::setProgressCallback(const std::function<void(int, int)>& callback)
+{
+	progress_ = callback;
+}
+
+void CRWCRSolver::setIntermediateCallback(const std::function<void(const float*)>& callback)
+{
+	intermediate_ = callback;
+}
+
+void CRWCRSolver::cancel()
+{
+	cancelled_ = true;
+}
+
+bool CRWCRSolver::isCancelled() const
+{
+	return cancelled_;
+}
+
+void CRWCRSolver::solveIncremental(const SeedRegion& region)
+{
+	(void)region;
+	solve();
+}
+
 void CRWCRSolver::solve()
 {
+	cancelled_ = false;
+	const int total = parameters_.maxIterations1D + parameters_.maxIterations2D;
+
 	cudaMemcpy(d_seedBuffer_, seeds_->getSeedBuffer(), numPixels_ * sizeof(unsigned char), cudaMemcpyHostToDevice);
 
 	cudaEvent_t start, stop;
@@ -69,7 +114,7 @@ void CRWCRSolver::solve()
 
 	int2 dim = make_int2(width_, height_);
 
-	for(int iter=0;iter<parameters_.maxIterations1D;iter++)
+	for(int iter=0;iter<parameters_.maxIterations1D && !cancelled_;iter++)
 	{
 		CRWCRGPU::rowSweepKernel << <dimGrid, dimBlock >> > (d_wx, d_grad,
 			d_seedBuffer_, d_matSub, d_matCen, d_matUp, d_rVec,dim,parameters_.gamma1D,parameters_.lambda1D);
@@ -80,9 +125,14 @@ void CRWCRSolver::solve()
 			d_seedBuffer_, d_matSub, d_matCen, d_matUp, d_rVec, dim, parameters_.gamma1D, parameters_.lambda1D);
 		CRWCRGPU::TDMAColumn << <dimG, dimB >> > (d_matSub, d_matCen, d_matUp, d_rVec, d_solution, dim);
 		CRWCRGPU::increaseSeedsKernel<<<dimGrid, dimBlock>>>(d_solution, d_seedBuffer_,dim, parameters_.foreThreshold);
+
+		if (progress_)
+		{
+			progress_(iter + 1, total);
+		}
 	}
 
-	for (int iter = 0; iter < parameters_.maxIterations2D; iter++)
+	for (int iter = 0; iter < parameters_.maxIterations2D && !cancelled_; iter++)
 	{
 		CRWCRGPU::PRRowKernel << <dimGrid, dimBlock >> > (d_wx, d_wy, d_grad,
 			d_solution, d_seedBuffer_, d_matSub, d_matCen, d_matUp, d_rVec,dim,parameters_.gamma2D,
@@ -93,6 +143,16 @@ void CRWCRSolver::solve()
 			d_solution, d_seedBuffer_, d_matSub, d_matCen, d_matUp, d_rVec
 			, dim, parameters_.gamma2D,	parameters_.lambda2D, parameters_.dt);
 		CRWCRGPU::TDMAColumn << <dimG, dimB >> > (d_matSub, d_matCen, d_matUp, d_rVec, d_solution, dim);
+
+		if (intermediate_)
+		{
+			cudaMemcpy(solution_, d_solution, numPixels_ * sizeof(float), cudaMemcpyDeviceToHost);
+			intermediate_(solution_);
+		}
+		if (progress_)
+		{
+			progress_(parameters_.maxIterations1D + iter + 1, total);
+		}
 	}
 
 	cudaMemcpy(solution_, d_solution, numPixels_ * sizeof(float), cudaMemcpyDeviceToHost);
@@ -109,6 +169,22 @@ float * CRWCRSolver::generateProbabilityImage() const
 	return solution_;
 }
 
+unsigned short* CRWCRSolver::generateProbabilityImage16()
+{
+	if (probability16_ == nullptr)
+	{
+		probability16_ = new unsigned short[numPixels_];
+	}
+
+	for (size_t i = 0; i < numPixels_; i++)
+	{
+		const float p = std::min(std::max(solution_[i], 0.f), 1.f);
+		probability16_[i] = static_cast<unsigned short>(p * 65535.f + 0.5f);
+	}
+
+	return probability16_;
+}
+
 int CRWCRSolver::getUseTime()const
 {
 	return time_;
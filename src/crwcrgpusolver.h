@@ -1,21 +1,68 @@
 #ifndef CRWCRGPUSOLVER_H
 #define CRWCRGPUSOLVER_H
 
-#include"twolabelseed.h"
+#include <atomic>
+#include <functional>
+#include"seedbuffer.h"
 #include"singleton.h"
 
 class CRWCRSolver
 {
 public:
-	CRWCRSolver(const float* image,int width, int height);
+	/**
+	 * \param probability :caller buffer the probability map is copied back to, nullptr lets the solver own it
+	 */
+	CRWCRSolver(const float* image,int width, int height, float* probability = nullptr);
 	~CRWCRSolver();
 
-	void setSeed(TwoLabelSeed* seed);
+	void setSeed(SeedBuffer* seed);
+
+	/**
+	 * \brief parameters of the following solves, otherwise those of Singleton<Parameters> at construction
+	 * \param parameters 
+	 */
+	void setParameters(const Parameters& parameters);
 
 	void solve();
 
+	/**
+	 * \brief the CPU solver re-solves a window around the new strokes, this one solves the whole image again
+	 * \param region 
+	 */
+	void solveIncremental(const SeedRegion& region);
+
 	float* generateProbabilityImage()const;
 
+	/**
+	 * \brief the probability map in 16-bit fixed point, 65535 is probability 1.
+	 * The buffer is owned by the solver and refreshed on every call.
+	 */
+	unsigned short* generateProbabilityImage16();
+
+	/**
+	 * \brief called with the iterations done and the total after every 1D and PR iteration, once
+	 * its kernels are queued
+	 * \param callback 
+	 */
+	void setProgressCallback(const std::function<void(int, int)>& callback);
+
+	/**
+	 * \brief called with the probability map after every PR iteration, which copies it back from
+	 * the device each time. An empty callback publishes nothing.
+	 * \param callback 
+	 */
+	void setIntermediateCallback(const std::function<void(const float*)>& callback);
+
+	/**
+	 * \brief stop the running solve after its current iteration, callable from any thread
+	 */
+	void cancel();
+
+	/**
+	 * \brief whether the last solve was stopped by cancel
+	 */
+	bool isCancelled() const;
+
 	int getUseTime()const;
 
 private:
@@ -26,11 +73,12 @@ private:
 
 	void calculateGradient();
 
-	Parameters& parameters_;
+	// a copy, so that the parameters cannot change during a solve
+	Parameters parameters_;
 
 	int time_;
 
-	TwoLabelSeed* seeds_;
+	SeedBuffer* seeds_;
 	unsigned char* d_seedBuffer_;
 
 	const float *image_;
@@ -42,6 +90,12 @@ private:
 
 	float* d_grad;
 	float* d_solution, *solution_;
+	bool ownsSolution_;
+	unsigned short* probability16_;
+
+	std::function<void(int, int)> progress_;
+	std::function<void(const float*)> intermediate_;
+	std::atomic<bool> cancelled_;
 	float* d_matCen, *d_matSub, *d_rVec, *d_matUp;
 
 };
@@ -0,0 +1,738 @@
+#include "kernels.h"
+#include "batchtdma.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * \brief Microbenchmark of the solver kernels on synthetic lines and tiles, one thread. Every
+ * kernel runs in every variant the processor supports, and the median time of a run is reported
+ * per element, as bandwidth of the arrays it touches and, on Linux, as retired instructions per
+ * element. The results of every variant are compared with those of the baseline kernels, the
+ * scalar reference unless the project flags raise it.
+ */
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	const int lanes = BatchTDMA::numLanes;
+
+	struct Options
+	{
+		int numRuns = 20;
+		int numWarmup = 2;
+		// nodes per line and rows per tile
+		int length = 4096;
+		// lines, rounded up to whole batches, and columns per tile
+		int numLines = 256;
+		int numChunks = 4;
+		// largest relative error against the baseline kernels that passes
+		double tolerance = 1e-4;
+		std::string isa;
+		std::string csvPath;
+	};
+
+	void printUsage()
+	{
+		printf(
+			"usage: crwcr_kernelbench [options]\n"
+			"\n"
+			"options:\n"
+			"  -n N              timed runs per kernel, default 20\n"
+			"  -w N              untimed warm-up runs per kernel, default 2\n"
+			"  --length N        nodes per line and rows per tile, default 4096\n"
+			"  --lines N         lines and tile columns, rounded up to a multiple of 16, default 256\n"
+			"  --chunks N        chunks per line of the partitioned solve, default 4\n"
+			"  --isa NAME        run only the variant NAME (scalar, avx2 or avx512)\n"
+			"  --tolerance R     largest relative error against the baseline, exits with 1 above it, default 1e-4\n"
+			"  --csv FILE        write the results as CSV\n");
+	}
+
+	/**
+	 * \brief instructions retired by the calling thread in user space, perf_event_open on Linux
+	 */
+	class InstructionCounter
+	{
+	public:
+		InstructionCounter() :
+			fd_(-1)
+		{
+#ifdef __linux__
+			perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.size = sizeof(attr);
+			attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+			attr.disabled = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			fd_ = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+		}
+
+		~InstructionCounter()
+		{
+#ifdef __linux__
+			if (fd_ >= 0)
+			{
+				close(fd_);
+			}
+#endif
+		}
+
+		InstructionCounter(const InstructionCounter&) = delete;
+		InstructionCounter& operator=(const InstructionCounter&) = delete;
+
+		/**
+		 * \brief false without a hardware counter, e.g. in virtual machines or for perf_event_paranoid
+		 */
+		bool isValid() const
+		{
+			return fd_ >= 0;
+		}
+
+		void start()
+		{
+#ifdef __linux__
+			if (fd_ >= 0)
+			{
+				ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+				ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+			}
+#endif
+		}
+
+		/**
+		 * \brief instructions since start, -1 without a counter
+		 */
+		long long stop()
+		{
+			long long count = -1;
+#ifdef __linux__
+			if (fd_ >= 0)
+			{
+				ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+				if (read(fd_, &count, sizeof(count)) != sizeof(count))
+				{
+					count = -1;
+				}
+			}
+#endif
+			return count;
+		}
+
+	private:
+		int fd_;
+	};
+
+	/**
+	 * \brief the synthetic inputs, the same for every variant, and the working copies the kernels
+	 * overwrite
+	 */
+	struct Data
+	{
+		int length, numBatches;
+
+		// numBatches interleaved batches of diagonally dominant systems of length nodes
+		std::vector<float> a, b, c, d;
+		// LU factors of the systems by the baseline kernels
+		std::vector<float> upper, pivot;
+		// three right vectors per system, node by node
+		std::vector<float> rhs3;
+		std::vector<int> bounds;
+		std::vector<float> borders;
+
+		// tile of numBatches * numLanes columns and length rows
+		std::vector<float> u;
+		std::vector<WeightType> wx, wy, grad;
+		// LU factors of the PR systems along the columns of the tile, whose lower diagonal is -wy
+		std::vector<float> prUpper, prPivot;
+		std::vector<unsigned char> labels;
+		std::vector<unsigned char> rgba;
+
+		std::vector<float> workA, workC, workD, x;
+		std::vector<WeightType> workWx, workWy, workGrad;
+
+		size_t batchSize() const
+		{
+			return size_t(length) * lanes;
+		}
+
+		int width() const
+		{
+			return numBatches * lanes;
+		}
+
+		size_t numPixels() const
+		{
+			return size_t(width()) * length;
+		}
+	};
+
+	/**
+	 * \brief uniform in [low, high), the same sequence on every platform
+	 */
+	class Random
+	{
+	public:
+		explicit Random(unsigned seed) :
+			state_(seed)
+		{
+		}
+
+		float next(float low, float high)
+		{
+			state_ = state_ * 1103515245 + 12345;
+			return low + (high - low) * float((state_ >> 8) & 0xffffff) / float(1 << 24);
+		}
+
+	private:
+		unsigned state_;
+	};
+
+	void prepare(Data& data, const Options& options)
+	{
+		data.length = options.length;
+		data.numBatches = (options.numLines + lanes - 1) / lanes;
+
+		const size_t size = data.batchSize() * data.numBatches;
+		Random random(1);
+
+		// edge weights in (0, 1] as the solver makes them, and a diagonal term like lambda and dt
+		data.a.resize(size);
+		data.b.resize(size);
+		data.c.resize(size);
+		data.d.resize(size);
+		for (size_t i = 0; i < size; i++)
+		{
+			data.a[i] = -random.next(1e-5f, 1.f);
+			data.c[i] = -random.next(1e-5f, 1.f);
+			data.b[i] = -(data.a[i] + data.c[i]) + random.next(0.f, 0.2f) + 0.05f;
+			data.d[i] = random.next(0.f, 1.f);
+		}
+
+		data.upper.resize(size);
+		data.pivot.resize(size);
+		for (int batch = 0; batch < data.numBatches; batch++)
+		{
+			const size_t o = batch * data.batchSize();
+			Kernels::baseline().factorize(&data.a[o], &data.b[o], &data.c[o], &data.upper[o], &data.pivot[o],
+			                              data.length);
+		}
+
+		data.rhs3.resize(size * 3);
+		for (float& v : data.rhs3)
+		{
+			v = random.next(0.f, 1.f);
+		}
+
+		const int chunks = std::max(1, std::min(options.numChunks, data.length / 3));
+		data.bounds.resize(chunks + 1);
+		for (int k = 0; k <= chunks; k++)
+		{
+			data.bounds[k] = int(size_t(k) * data.length / chunks);
+		}
+		data.borders.resize(size_t(2) * chunks * lanes);
+
+		const size_t numPixels = data.numPixels();
+		data.u.resize(numPixels);
+		data.wx.resize(numPixels);
+		data.wy.resize(numPixels);
+		data.grad.resize(numPixels);
+		data.labels.resize(numPixels);
+		data.rgba.resize(numPixels * 4);
+		for (size_t i = 0; i < numPixels; i++)
+		{
+			data.u[i] = random.next(0.f, 1.f);
+			data.wx[i] = WeightType(random.next(0.f, 1.f));
+			data.wy[i] = WeightType(random.next(0.f, 1.f));
+			data.grad[i] = WeightType(random.next(0.f, 1.f));
+			data.labels[i] = static_cast<unsigned char>(random.next(0.f, 3.f));
+		}
+		for (unsigned char& v : data.rgba)
+		{
+			v = static_cast<unsigned char>(random.next(0.f, 256.f));
+		}
+
+		// wy is column-major, column x holds the weights of line x
+		data.prUpper.resize(size);
+		data.prPivot.resize(size);
+		std::vector<float> a(data.batchSize()), b(data.batchSize());
+		for (int batch = 0; batch < data.numBatches; batch++)
+		{
+			const size_t o = batch * data.batchSize();
+			for (int i = 0; i < data.length; i++)
+			{
+				for (int l = 0; l < lanes; l++)
+				{
+					const int k = i * lanes + l;
+					a[k] = i > 0 ? -toFloat(data.wy[size_t(batch * lanes + l) * data.length + i - 1]) : 0;
+					b[k] = -(a[k] + data.c[o + k]) + 0.1f;
+				}
+			}
+			Kernels::baseline().factorize(a.data(), b.data(), &data.c[o], &data.prUpper[o], &data.prPivot[o],
+			                              data.length);
+		}
+
+		data.workA.resize(size);
+		data.workC.resize(size);
+		data.workD.resize(size * 3);
+		// the row right vectors fill the lanes of the last batch of rows
+		data.x.resize(std::max(size, size_t(data.length + lanes - 1) / lanes * lanes * data.width()));
+	}
+
+	/**
+	 * \brief one kernel on the synthetic data. reset restores the working copies before every run,
+	 * outside the timing, and output reads the result of the last run.
+	 */
+	struct Benchmark
+	{
+		std::string name;
+		// per run
+		double elements;
+		// read and written per run, every array counted once per pass
+		double bytes;
+		std::function<void()> reset;
+		std::function<void(const Kernels::Set&)> run;
+		std::function<std::vector<float>()> output;
+	};
+
+	std::vector<float> weightsToFloat(const std::vector<WeightType>& weights)
+	{
+		std::vector<float> values(weights.size());
+		for (size_t i = 0; i < weights.size(); i++)
+		{
+			values[i] = toFloat(weights[i]);
+		}
+		return values;
+	}
+
+	std::vector<Benchmark> benchmarks(Data& data)
+	{
+		const size_t size = data.batchSize() * data.numBatches;
+		const double nodes = double(size), pixels = double(data.numPixels());
+		const double weight = double(sizeof(WeightType));
+
+		auto copyLines = [&data]()
+		{
+			std::copy(data.a.begin(), data.a.end(), data.workA.begin());
+			std::copy(data.c.begin(), data.c.end(), data.workC.begin());
+			std::copy(data.d.begin(), data.d.end(), data.workD.begin());
+		};
+		auto lineResult = [&data, size]() { return std::vector<float>(data.workD.begin(), data.workD.begin() + size); };
+
+		std::vector<Benchmark> list;
+
+		// forward: a, b, c, d read, c, d written; backward: c, d read, x written
+		list.push_back({
+			"tdma solve", nodes, nodes * 36, copyLines,
+			[&data](const Kernels::Set& k)
+			{
+				for (int batch = 0; batch < data.numBatches; batch++)
+				{
+					const size_t o = batch * data.batchSize();
+					k.solve(&data.a[o], &data.b[o], &data.workC[o], &data.workD[o], &data.x[o], data.length);
+				}
+			},
+			[&data, size]() { return std::vector<float>(data.x.begin(), data.x.begin() + size); }
+		});
+
+		// a, b, c read, upper and pivot written
+		list.push_back({
+			"lu factorize", nodes, nodes * 20, copyLines,
+			[&data](const Kernels::Set& k)
+			{
+				for (int batch = 0; batch < data.numBatches; batch++)
+				{
+					const size_t o = batch * data.batchSize();
+					k.factorize(&data.a[o], &data.b[o], &data.c[o], &data.workC[o], &data.x[o], data.length);
+				}
+			},
+			[&data, size]() { return std::vector<float>(data.x.begin(), data.x.begin() + size); }
+		});
+
+		// forward: a, pivot, d read, d written; backward: upper, d read, d written
+		list.push_back({
+			"lu substitute", nodes, nodes * 24, copyLines,
+			[&data](const Kernels::Set& k)
+			{
+				for (int batch = 0; batch < data.numBatches; batch++)
+				{
+					const size_t o = batch * data.batchSize();
+					k.substitute(&data.a[o], &data.upper[o], &data.pivot[o], &data.workD[o], data.length);
+				}
+			},
+			lineResult
+		});
+
+		// as lu substitute with the lower diagonal read from the weights, as the PR sweeps call it
+		list.push_back({
+			"pr substitute", nodes, nodes * (20 + weight), copyLines,
+			[&data](const Kernels::Set& k)
+			{
+				for (int batch = 0; batch < data.numBatches; batch++)
+				{
+					const size_t o = batch * data.batchSize();
+					k.substituteWeights(&data.wy[size_t(batch * lanes) * data.length], data.length, lanes,
+					                    &data.prUpper[o], &data.prPivot[o], &data.workD[o], data.length, 1);
+				}
+			},
+			lineResult
+		});
+
+		// per node the factors once and three right vectors read and written in both sweeps
+		list.push_back({
+			"lu substitute 3 rhs", nodes * 3, nodes * 60,
+			[&data]() { std::copy(data.rhs3.begin(), data.rhs3.end(), data.workD.begin()); },
+			[&data](const Kernels::Set& k)
+			{
+				for (int batch = 0; batch < data.numBatches; batch++)
+				{
+					const size_t o = batch * data.batchSize();
+					k.substituteMany(&data.a[o], &data.upper[o], &data.pivot[o], &data.workD[o * 3], data.length, 3);
+				}
+			},
+			[&data]() { return data.workD; }
+		});
+
+		// reduction: a, b, c, d read, a, c, d written, then a, c, d once more; substitution: a, c, d
+		// read, d written
+		list.push_back({
+			"partitioned solve " + std::to_string(data.bounds.size() - 1) + " chunks", nodes, nodes * 68, copyLines,
+			[&data](const Kernels::Set& k)
+			{
+				const int chunks = int(data.bounds.size()) - 1;
+				for (int batch = 0; batch < data.numBatches; batch++)
+				{
+					const size_t o = batch * data.batchSize();
+					float* a = &data.workA[o];
+					float* c = &data.workC[o];
+					float* d = &data.workD[o];
+					for (int chunk = 0; chunk < chunks; chunk++)
+					{
+						k.reduceChunk(a, &data.b[o], c, d, data.bounds[chunk], data.bounds[chunk + 1]);
+					}
+					k.solveChunkBorders(a, c, d, data.bounds.data(), chunks, data.borders.data());
+					for (int chunk = 0; chunk < chunks; chunk++)
+					{
+						k.substituteChunk(a, c, d, data.bounds[chunk], data.bounds[chunk + 1]);
+					}
+				}
+			},
+			lineResult
+		});
+
+		// u, the weights and the labels read, d written. The column sweep of CRWCRSolver calls the
+		// kernel once per tile of 64 rows, which it eliminates before the next one.
+		list.push_back({
+			"column rhs", pixels, pixels * (4 + weight + 1 + 4), []() {},
+			[&data](const Kernels::Set& k)
+			{
+				const int tileRows = 64;
+				const int width = data.width();
+				for (int batch = 0; batch < data.numBatches; batch++)
+				{
+					float* d = &data.x[batch * data.batchSize()];
+					for (int y0 = 0; y0 < data.length; y0 += tileRows)
+					{
+						const int rows = std::min(tileRows, data.length - y0);
+						const size_t row = size_t(y0) * width;
+						k.columnRhs(&data.u[row], &data.wx[row], &data.labels[row], 1, -y0, data.length - y0, 1000.f, 0.1f,
+						            batch * lanes, lanes, width, rows, d + size_t(y0) * lanes, lanes);
+					}
+				}
+			},
+			[&data]() { return std::vector<float>(data.x.begin(), data.x.begin() + data.numPixels()); }
+		});
+
+		// the same for the row sweep, 16 rows at a time with the vertical weights column-major
+		list.push_back({
+			"row rhs", pixels, pixels * (4 + weight + 1 + 4), []() {},
+			[&data](const Kernels::Set& k)
+			{
+				const int width = data.width();
+				for (int y0 = 0; y0 < data.length; y0 += lanes)
+				{
+					k.rowRhs(data.u.data(), data.wy.data(), data.labels.data(), 1, 0, width, 1000.f, 0.1f, y0,
+					         std::min(lanes, data.length - y0), width, data.length, &data.x[size_t(y0) * width], lanes);
+				}
+			},
+			[&data]() { return std::vector<float>(data.x.begin(), data.x.begin() + data.numPixels()); }
+		});
+
+		// wx, wy and grad read and written
+		list.push_back({
+			"map weights", pixels, pixels * 6 * weight,
+			[&data]()
+			{
+				data.workWx = data.wx;
+				data.workWy = data.wy;
+				data.workGrad = data.grad;
+			},
+			[&data](const Kernels::Set& k)
+			{
+				const float offset[3] = {0.01f, 0.02f, 0.03f}, scale[3] = {1.5f, 1.25f, 1.1f};
+				const int width = data.width();
+				for (int y = 0; y < data.length; y++)
+				{
+					const size_t row = size_t(y) * width;
+					k.mapWeights(&data.workWx[row], &data.workWy[row], &data.workGrad[row], width, offset, scale, 100.f,
+					             1e-5f);
+				}
+			},
+			[&data]()
+			{
+				std::vector<float> values = weightsToFloat(data.workWx);
+				const std::vector<float> wy = weightsToFloat(data.workWy), grad = weightsToFloat(data.workGrad);
+				values.insert(values.end(), wy.begin(), wy.end());
+				values.insert(values.end(), grad.begin(), grad.end());
+				return values;
+			}
+		});
+
+		// 4 bytes of every pixel read, a float written
+		list.push_back({
+			"gray rgba8", pixels, pixels * 8, []() {},
+			[&data](const Kernels::Set& k)
+			{
+				const int width = data.width();
+				for (int y = 0; y < data.length; y++)
+				{
+					k.rgba8Row(&data.rgba[size_t(y) * width * 4], &data.x[size_t(y) * width], width);
+				}
+			},
+			[&data]() { return std::vector<float>(data.x.begin(), data.x.begin() + data.numPixels()); }
+		});
+
+		// a byte read, a float written
+		list.push_back({
+			"gray gray8", pixels, pixels * 5, []() {},
+			[&data](const Kernels::Set& k)
+			{
+				const int width = data.width();
+				for (int y = 0; y < data.length; y++)
+				{
+					k.gray8Row(&data.rgba[size_t(y) * width], &data.x[size_t(y) * width], width);
+				}
+			},
+			[&data]() { return std::vector<float>(data.x.begin(), data.x.begin() + data.numPixels()); }
+		});
+
+		return list;
+	}
+
+	struct Result
+	{
+		std::string kernel, isa;
+		double nsPerElement, gbPerSecond;
+		// -1 without a hardware counter
+		double instructionsPerElement;
+		// against the baseline kernels, the largest absolute difference and that over the largest magnitude
+		double maxError, relativeError;
+	};
+
+	double median(std::vector<double> values)
+	{
+		std::sort(values.begin(), values.end());
+		const size_t n = values.size();
+		return n % 2 ? values[n / 2] : 0.5 * (values[n / 2 - 1] + values[n / 2]);
+	}
+
+	Result measure(Benchmark& benchmark, const Kernels::Set& kernels, const std::vector<float>& reference,
+	               const Options& options, InstructionCounter& counter)
+	{
+		std::vector<double> times, instructions;
+		for (int run = 0; run < options.numWarmup + options.numRuns; run++)
+		{
+			benchmark.reset();
+
+			counter.start();
+			const auto start = Clock::now();
+			benchmark.run(kernels);
+			const auto stop = Clock::now();
+			const long long count = counter.stop();
+
+			if (run >= options.numWarmup)
+			{
+				times.push_back(std::chrono::duration<double, std::nano>(stop - start).count());
+				instructions.push_back(double(count));
+			}
+		}
+
+		Result result;
+		result.kernel = benchmark.name;
+		result.isa = kernels.name;
+		const double time = median(times);
+		result.nsPerElement = time / benchmark.elements;
+		result.gbPerSecond = benchmark.bytes / time;
+		result.instructionsPerElement = counter.isValid() ? median(instructions) / benchmark.elements : -1;
+
+		const std::vector<float> values = benchmark.output();
+		double maxError = 0, magnitude = 0;
+		for (size_t i = 0; i < values.size(); i++)
+		{
+			maxError = std::max(maxError, double(std::fabs(values[i] - reference[i])));
+			magnitude = std::max(magnitude, double(std::fabs(reference[i])));
+		}
+		result.maxError = maxError;
+		result.relativeError = magnitude > 0 ? maxError / magnitude : maxError;
+		return result;
+	}
+
+	bool writeCsv(const std::string& path, const std::vector<Result>& results, const Data& data)
+	{
+		std::ofstream file(path);
+		if (!file)
+		{
+			return false;
+		}
+
+		file << "kernel,isa,length,lines,ns_per_element,gb_per_s,instructions_per_element,max_error,relative_error\n";
+		for (const auto& r : results)
+		{
+			file << r.kernel << ',' << r.isa << ',' << data.length << ',' << data.width() << ',' << r.nsPerElement << ','
+				<< r.gbPerSecond << ',';
+			if (r.instructionsPerElement >= 0)
+			{
+				file << r.instructionsPerElement;
+			}
+			file << ',' << r.maxError << ',' << r.relativeError << '\n';
+		}
+		return bool(file);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		if (i + 1 >= argc)
+		{
+			printUsage();
+			return 2;
+		}
+
+		if (arg == "-n")
+		{
+			options.numRuns = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "-w")
+		{
+			options.numWarmup = std::max(0, atoi(argv[++i]));
+		}
+		else if (arg == "--length")
+		{
+			options.length = std::max(3, atoi(argv[++i]));
+		}
+		else if (arg == "--lines")
+		{
+			options.numLines = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--chunks")
+		{
+			options.numChunks = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--isa")
+		{
+			options.isa = argv[++i];
+		}
+		else if (arg == "--tolerance")
+		{
+			options.tolerance = atof(argv[++i]);
+		}
+		else if (arg == "--csv")
+		{
+			options.csvPath = argv[++i];
+		}
+		else
+		{
+			printUsage();
+			return 2;
+		}
+	}
+
+	// the variants this processor can run, the baseline first as the reference
+	std::vector<const Kernels::Set*> variants = {&Kernels::baseline()};
+#ifdef CRWCR_CPU_DISPATCH
+	for (const Kernels::Set* variant : {&Kernels::avx2(), &Kernels::avx512()})
+	{
+		if (variant->isa > Kernels::baseline().isa && variant->isa <= Kernels::detect())
+		{
+			variants.push_back(variant);
+		}
+	}
+#endif
+
+	Data data;
+	prepare(data, options);
+	std::vector<Benchmark> list = benchmarks(data);
+
+	InstructionCounter counter;
+	printf("%d lines of %d nodes, %d tile pixels, %d runs per kernel, reference %s, instructions %s\n\n",
+	       data.width(), data.length, int(data.numPixels()), options.numRuns, Kernels::baseline().name,
+	       counter.isValid() ? "counted" : "not available");
+	printf("%-28s %-8s %10s %10s %12s %12s %12s\n", "kernel", "isa", "ns/elem", "GB/s", "instr/elem", "max error",
+	       "relative");
+
+	std::vector<Result> results;
+	int numFailed = 0;
+	for (Benchmark& benchmark : list)
+	{
+		benchmark.reset();
+		benchmark.run(Kernels::baseline());
+		const std::vector<float> reference = benchmark.output();
+
+		for (const Kernels::Set* variant : variants)
+		{
+			if (!options.isa.empty() && options.isa != variant->name)
+			{
+				continue;
+			}
+
+			results.push_back(measure(benchmark, *variant, reference, options, counter));
+			const Result& r = results.back();
+			printf("%-28s %-8s %10.3f %10.2f ", r.kernel.c_str(), r.isa.c_str(), r.nsPerElement, r.gbPerSecond);
+			if (r.instructionsPerElement >= 0)
+			{
+				printf("%12.2f", r.instructionsPerElement);
+			}
+			else
+			{
+				printf("%12s", "-");
+			}
+			const bool failed = !(r.relativeError <= options.tolerance);
+			printf(" %12.3g %12.3g%s\n", r.maxError, r.relativeError, failed ? "  FAILED" : "");
+			numFailed += failed;
+		}
+	}
+
+	if (!options.csvPath.empty() && !writeCsv(options.csvPath, results, data))
+	{
+		fprintf(stderr, "cannot write %s\n", options.csvPath.c_str());
+		return 2;
+	}
+
+	if (numFailed > 0)
+	{
+		printf("\n%d kernel runs differ from the baseline by more than %g\n", numFailed, options.tolerance);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,109 @@
+#include "crwcrslabsolver.h"
+#include "crwcrvolumesolver.h"
+#include "mappedfile.h"
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+CRWCRSlabSolver::CRWCRSlabSolver(int width, int height, int depth) :
+	parameters_(Singleton<Parameters>::GetInstance()),
+	width_(width),
+	height_(height),
+	depth_(depth),
+	time_(0),
+	solvedSlabs_(0)
+{
+}
+
+bool CRWCRSlabSolver::solve(const std::string& volumePath, const std::string& labelPath,
+                            const std::string& outputPath)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	const size_t sliceSize = size_t(width_) * height_;
+	const size_t numVoxels = sliceSize * depth_;
+
+	MappedFile volume, labels, output;
+	if (!volume.openRead(volumePath) || volume.size() != numVoxels * sizeof(float) ||
+		!labels.openRead(labelPath) || labels.size() != numVoxels ||
+		!output.create(outputPath, numVoxels * sizeof(float)))
+	{
+		return false;
+	}
+
+	const float* volumeData = reinterpret_cast<const float*>(volume.data());
+	const unsigned char* labelData = reinterpret_cast<const unsigned char*>(labels.data());
+	float* outputData = reinterpret_cast<float*>(output.data());
+
+	// the weights of every slab are normalized with the range of the whole volume, as a solve of
+	// the whole volume would. The pass reads the volume once, its pages are dropped afterwards.
+	const VolumeWeightBounds bounds = CRWCRVolumeSolver::weightBounds(volumeData, width_, height_, depth_,
+	                                                                  parameters_.numThreads);
+	volume.release(0, numVoxels * sizeof(float));
+
+	const int core = getSlabDepth();
+	const int halo = parameters_.slabHalo;
+
+	solvedSlabs_ = 0;
+	for (int z0 = 0; z0 < depth_; z0 += core)
+	{
+		const int z1 = std::min(z0 + core, depth_);
+		// the solver needs 2 slices at least, which a halo of 0 may not leave the last slab
+		const int haloZ1 = std::min(z1 + halo, depth_);
+		const int haloZ0 = std::min(std::max(z0 - halo, 0), std::max(haloZ1 - 2, 0));
+		const int sd = haloZ1 - haloZ0;
+
+		// slabs are contiguous, so the solver reads the mapped volume and labels in place
+		const float* slabVolume = volumeData + haloZ0 * sliceSize;
+		const unsigned char* slabLabels = labelData + haloZ0 * sliceSize;
+
+		// without foreground seeds the probability stays 0, no need to run the solver
+		if (std::find(slabLabels, slabLabels + sd * sliceSize, 1) == slabLabels + sd * sliceSize)
+		{
+			std::fill(outputData + z0 * sliceSize, outputData + z1 * sliceSize, 0.f);
+		}
+		else
+		{
+			CRWCRVolumeSolver solver(slabVolume, width_, height_, sd, &bounds);
+			solver.setParameters(parameters_);
+			solver.setSeed(slabLabels);
+			solver.solve();
+
+			const float* probability = solver.generateProbabilityVolume();
+			memcpy(outputData + z0 * sliceSize, probability + (z0 - haloZ0) * sliceSize,
+			       (z1 - z0) * sliceSize * sizeof(float));
+			solvedSlabs_++;
+		}
+
+		// slices below the next slab's halo are not read again, and this slab's output is complete
+		const size_t doneSlices = size_t(std::max(z1 - halo, 0));
+		volume.release(0, doneSlices * sliceSize * sizeof(float));
+		labels.release(0, doneSlices * sliceSize);
+		output.release(0, z1 * sliceSize * sizeof(float));
+	}
+
+	std::chrono::duration<float, std::milli> diff = std::chrono::steady_clock::now() - start;
+	time_ = diff.count();
+
+	return true;
+}
+
+float CRWCRSlabSolver::getUseTime() const
+{
+	return time_;
+}
+
+int CRWCRSlabSolver::getSlabDepth() const
+{
+	// the most slices, halo included, whose solver fits into the budget
+	const double budget = double(parameters_.tileMemoryMB) * 1024 * 1024;
+	const int slices = int(budget / (double(bytesPerVoxel) * width_ * height_));
+	const int minSlabDepth = 8;
+
+	return std::max(slices - 2 * parameters_.slabHalo, minSlabDepth);
+}
+
+int CRWCRSlabSolver::getSolvedSlabs() const
+{
+	return solvedSlabs_;
+}
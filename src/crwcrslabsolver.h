@@ -0,0 +1,64 @@
+#ifndef CRWCRSLABSOLVER_H
+#define CRWCRSLABSOLVER_H
+
+#include <string>
+#include "singleton.h"
+
+
+/**
+ * \brief Solve volumes larger than the memory slab by slab. The volume, the seed labels and the
+ * probability volume are raw files in slice order, memory-mapped and streamed through
+ * CRWCRVolumeSolver one slab of whole slices at a time. Each slab is solved with a halo of its
+ * neighbours' slices so that the cut does not show in the result.
+ *
+ * File formats: volume float32, labels uint8 with 0: none, 1: foreground, 2: background,
+ * probability volume float32, all width * height * depth values without header, voxel
+ * (x, y, z) at x + y * width + z * width * height.
+ */
+class CRWCRSlabSolver
+{
+public:
+	CRWCRSlabSolver(int width, int height, int depth);
+
+	/**
+	 * \brief solve the mapped volume slab by slab
+	 * \param volumePath
+	 * \param labelPath :only read
+	 * \param outputPath :created, or replaced if it exists
+	 * \return false if a file cannot be mapped or has the wrong size
+	 */
+	bool solve(const std::string& volumePath, const std::string& labelPath, const std::string& outputPath);
+
+	float getUseTime() const;
+
+	/**
+	 * \brief slices of the slab cores, derived from Parameters::tileMemoryMB
+	 */
+	int getSlabDepth() const;
+
+	/**
+	 * \brief number of slabs the last solve ran the solver on, slabs without foreground are skipped
+	 */
+	int getSolvedSlabs() const;
+
+	/**
+	 * \brief estimated memory per voxel of a slab including its halo: the solver arrays and the
+	 * mapped pages of the volume and the labels. The solver reads both files in place.
+	 */
+#ifdef CRWCR_COMPACT_MEMORY
+	static const size_t bytesPerVoxel = 22;
+#else
+	static const size_t bytesPerVoxel = 30;
+#endif
+
+private:
+	// a copy, so that the parameters cannot change during a solve
+	Parameters parameters_;
+
+	int width_, height_, depth_;
+	// milliseconds of the last solve
+	float time_;
+	int solvedSlabs_;
+};
+
+#endif // CRWCRSLABSOLVER_H
@@ -1,418 +1,1860 @@
 #include "crwcrsolver.h"
+#include "batchtdma.h"
+#include "kernels.h"
+#include "profiler.h"
 #include<cmath>
-#include <iostream>
 #include <chrono>
 #include <algorithm>
 #include<fstream>
+#include <cstring>
+#include <vector>
 
-CRWCRSolver::CRWCRSolver(const float* image, int width, int height) :
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace
+{
+	/**
+	 * \brief edge weight between two neighbouring 2x2 blocks of a finer level. Along every line
+	 * through both blocks the edge between them and the halves of the edges inside them are in
+	 * series, and the lines are in parallel. Uniform weights stay the same, and a weak edge inside
+	 * a block still separates it from its neighbour.
+	 * \param w :w(i, j) is the weight from node i to i + 1 of fine line j
+	 * \param i :first node of the first block along the lines, i + 2 < numRow
+	 * \param numRow :nodes per fine line
+	 * \param j :first line through the blocks
+	 * \param numLines :1 or 2
+	 */
+	template <typename Weight>
+	float blockWeight(Weight w, int i, int numRow, int j, int numLines)
+	{
+		float conductance = 0;
+		for (int k = j; k < j + numLines; k++)
+		{
+			float resistance = 0.5f / w(i, k) + 1 / w(i + 1, k);
+			if (i + 3 < numRow)
+			{
+				resistance += 0.5f / w(i + 2, k);
+			}
+			conductance += 1 / resistance;
+		}
+		return conductance * 2 / numLines;
+	}
+
+	/**
+	 * \brief halve a seed buffer. A coarse pixel takes the label found in its 2x2 block,
+	 * blocks holding both labels stay unlabeled.
+	 */
+	void downsampleSeeds(const unsigned char* seeds, int width, int height, unsigned char* coarse)
+	{
+		const int cw = (width + 1) / 2, ch = (height + 1) / 2;
+
+#pragma omp parallel for
+		for (int y = 0; y < ch; y++)
+		{
+			for (int x = 0; x < cw; x++)
+			{
+				unsigned char found = 0;
+				for (int j = 2 * y; j < std::min(2 * y + 2, height); j++)
+				{
+					for (int i = 2 * x; i < std::min(2 * x + 2, width); i++)
+					{
+						if (seeds[i + j * width] == 1) found |= 1;
+						else if (seeds[i + j * width] == 2) found |= 2;
+					}
+				}
+				// bit 0: foreground, bit 1: background
+				coarse[x + y * cw] = found == 1 ? 1 : found == 2 ? 2 : 0;
+			}
+		}
+	}
+
+	/**
+	 * \brief bilinear upsampling of a coarse probability map to twice its size
+	 */
+	void upsampleProbability(const float* coarse, int cw, int ch, float* fine, int width, int height)
+	{
+#pragma omp parallel for
+		for (int y = 0; y < height; y++)
+		{
+			const float fy = std::min(std::max(0.5f * y - 0.25f, 0.f), float(ch - 1));
+			const int y0 = int(fy), y1 = std::min(y0 + 1, ch - 1);
+			const float ty = fy - y0;
+
+			for (int x = 0; x < width; x++)
+			{
+				const float fx = std::min(std::max(0.5f * x - 0.25f, 0.f), float(cw - 1));
+				const int x0 = int(fx), x1 = std::min(x0 + 1, cw - 1);
+				const float tx = fx - x0;
+
+				fine[x + y * width] = (1 - ty) * ((1 - tx) * coarse[x0 + y0 * cw] + tx * coarse[x1 + y0 * cw]) +
+					ty * ((1 - tx) * coarse[x0 + y1 * cw] + tx * coarse[x1 + y1 * cw]);
+			}
+		}
+	}
+
+	/**
+	 * \brief gather the marked lines among 1 .. count - 2 in order and clear their marks
+	 * \param marks 
+	 * \param count 
+	 * \param lines 
+	 * \return number of lines
+	 */
+	int collectLines(unsigned char* marks, int count, int* lines)
+	{
+		int numLines = 0;
+		for (int line = 1; line < count - 1; line++)
+		{
+			if (marks[line] != 0)
+			{
+				marks[line] = 0;
+				lines[numLines++] = line;
+			}
+		}
+		return numLines;
+	}
+
+	/**
+	 * \brief line systems of a sweep whose lines are split into chunks, interleaved batch after batch
+	 */
+	struct PartitionedLines
+	{
+		int numBatches, numRow, numChunks;
+		std::vector<float> a, b, c, d;
+		// scratch of the border system of every batch
+		std::vector<float> borders;
+		// numChunks + 1 chunk borders
+		std::vector<int> bounds;
+
+		PartitionedLines() :
+			numBatches(0),
+			numRow(0),
+			numChunks(1)
+		{
+		}
+
+		/**
+		 * \brief the memory is kept when the lines get fewer
+		 */
+		void resize(int batches, int rows, int chunks)
+		{
+			const int lanes = BatchTDMA::numLanes;
+			const size_t size = size_t(batches) * rows * lanes;
+
+			numBatches = batches;
+			numRow = rows;
+			numChunks = chunks;
+			a.resize(size);
+			b.resize(size);
+			c.resize(size);
+			d.resize(size);
+			borders.resize(size_t(batches) * 2 * chunks * lanes);
+			bounds.resize(chunks + 1);
+			for (int k = 0; k <= chunks; k++)
+			{
+				bounds[k] = int(size_t(k) * rows / chunks);
+			}
+		}
+	};
+
+	/**
+	 * \brief solve the lines of a sweep chunk by chunk, so that a few long lines still keep every
+	 * thread busy. Called by all threads of the enclosing parallel region.
+	 * \param lines 
+	 * \param assemble :(batch, begin, end, a, b, c, d) builds the nodes [begin, end) of the lines of
+	 * a batch, the pointers at node 0
+	 * \param store :(batch, begin, end, x) takes the solution of the nodes [begin, end) of a batch
+	 */
+	template <typename Assemble, typename Store>
+	void partitionedSweep(PartitionedLines& lines, Assemble assemble, Store store)
+	{
+		const size_t batchSize = size_t(lines.numRow) * BatchTDMA::numLanes;
+		const int numChunks = lines.numChunks;
+		const int numTasks = lines.numBatches * numChunks;
+		const int* bounds = lines.bounds.data();
+		float* a = lines.a.data();
+		float* b = lines.b.data();
+		float* c = lines.c.data();
+		float* d = lines.d.data();
+
+		// a chunk reads only its own nodes, so it is reduced by the thread that assembled it
+#pragma omp for schedule(static)
+		for (int task = 0; task < numTasks; task++)
+		{
+			const int batch = task / numChunks, chunk = task % numChunks;
+			const size_t offset = batch * batchSize;
+			assemble(batch, bounds[chunk], bounds[chunk + 1], a + offset, b + offset, c + offset, d + offset);
+			BatchTDMA::reduceChunk(a + offset, b + offset, c + offset, d + offset, bounds[chunk], bounds[chunk + 1]);
+		}
+
+#pragma omp for schedule(static)
+		for (int batch = 0; batch < lines.numBatches; batch++)
+		{
+			const size_t offset = batch * batchSize;
+			BatchTDMA::solveChunkBorders(a + offset, c + offset, d + offset, bounds, numChunks,
+			                             lines.borders.data() + size_t(batch) * 2 * numChunks * BatchTDMA::numLanes);
+		}
+
+#pragma omp for schedule(static)
+		for (int task = 0; task < numTasks; task++)
+		{
+			const int batch = task / numChunks, chunk = task % numChunks;
+			const size_t offset = batch * batchSize;
+			BatchTDMA::substituteChunk(a + offset, c + offset, d + offset, bounds[chunk], bounds[chunk + 1]);
+			store(batch, bounds[chunk], bounds[chunk + 1], d + offset);
+		}
+	}
+}
+
+const int CRWCRSolver::columnTileRows;
+const int CRWCRSolver::minChunkRows;
+
+CRWCRSolver::CRWCRSolver(const float* image, int width, int height, float* probability,
+                         const WeightBounds* bounds) :
 	parameters_(Singleton<Parameters>::GetInstance()),
 	seeds_(nullptr),
+	labels_(nullptr),
 	image_(image),
 	width_(width),
-	height_(height)
+	height_(height),
+	solution_(probability),
+	ownsSolution_(probability == nullptr),
+	iterations_(0),
+	residual_(0),
+	dt_(0),
+	probability16_(nullptr),
+	cancelled_(false),
+	cancelRequest_(&cancelled_),
+	progressBase_(0),
+	progressTotal_(0),
+	numLabels_(0),
+	labelSolution_(nullptr),
+	labelImage_(nullptr)
+{
+	numPixels_ = size_t(width_) * height_;
+	if (ownsSolution_)
+	{
+		solution_ = new float[numPixels_];
+	}
+	wx_ = new WeightType[numPixels_];
+	wy_ = new WeightType[numPixels_];
+	grad_ = new WeightType[numPixels_];
+
+	// line factors are stored interleaved, numLanes lines per batch
+	numRowBatches_ = (height_ + BatchTDMA::numLanes - 1) / BatchTDMA::numLanes;
+	numColBatches_ = (width_ + BatchTDMA::numLanes - 1) / BatchTDMA::numLanes;
+#ifndef CRWCR_COMPACT_MEMORY
+	const size_t rowFactorSize = size_t(numRowBatches_) * BatchTDMA::numLanes * width_;
+	const size_t colFactorSize = size_t(numColBatches_) * BatchTDMA::numLanes * height_;
+	rowUpper_ = new float[rowFactorSize];
+	rowPivot_ = new float[rowFactorSize];
+	colUpper_ = new float[colFactorSize];
+	colPivot_ = new float[colFactorSize];
+#endif
+
+	// the coarser pyramid levels restrict the weights of the finer one instead
+	if (image_ != nullptr)
+	{
+		calculateWeightAndGradient(bounds);
+	}
+}
+
+CRWCRSolver::CRWCRSolver(const CRWCRSolver& fine, SeedBuffer* seeds) :
+	CRWCRSolver(nullptr, (fine.width_ + 1) / 2, (fine.height_ + 1) / 2)
+{
+	parameters_ = fine.parameters_;
+	cancelRequest_ = fine.cancelRequest_;
+	setSeed(seeds);
+	copySeeds();
+
+	auto wx = [&fine](int x, int y) { return toFloat(fine.wx_[x + size_t(y) * fine.width_]); };
+	auto wy = [&fine](int y, int x) { return toFloat(fine.wy_[y + size_t(x) * fine.height_]); };
+
+	// the weights of the outermost nodes towards the border are never read
+#pragma omp parallel for num_threads(numThreads())
+	for (int cy = 0; cy < height_; cy++)
+	{
+		const int y = 2 * cy, numRows = std::min(2, fine.height_ - y);
+		for (int cx = 0; cx < width_; cx++)
+		{
+			const int x = 2 * cx, numColumns = std::min(2, fine.width_ - x);
+			const size_t index = cx + size_t(cy) * width_;
+
+			wx_[index] = WeightType(cx < width_ - 1 ? blockWeight(wx, x, fine.width_, y, numRows) : 1.f);
+			wy_[cy + size_t(cx) * height_] =
+				WeightType(cy < height_ - 1 ? blockWeight(wy, y, fine.height_, x, numColumns) : 1.f);
+
+			float grad = 0;
+			for (int j = y; j < y + numRows; j++)
+			{
+				for (int i = x; i < x + numColumns; i++)
+				{
+					grad += toFloat(fine.grad_[i + size_t(j) * fine.width_]);
+				}
+			}
+			grad_[index] = WeightType(grad / (numRows * numColumns));
+		}
+	}
+}
+
+CRWCRSolver::~CRWCRSolver()
+{
+	if (ownsSolution_)
+	{
+		delete[] solution_;
+	}
+	delete[] wx_;
+	delete[] wy_;
+	delete[] grad_;
+	delete[] probability16_;
+	delete[] labelSolution_;
+	delete[] labelImage_;
+#ifndef CRWCR_COMPACT_MEMORY
+	delete[] rowUpper_;
+	delete[] rowPivot_;
+	delete[] colUpper_;
+	delete[] colPivot_;
+#endif
+}
+
+void CRWCRSolver::setSeed(SeedBuffer* seed)
+{
+	seeds_ = seed;
+}
+
+WeightBounds CRWCRSolver::weightBounds(const float* image, int width, int height, int numThreads)
 {
-	numPixels_ = width_ * height_;
-	solution_ = new float[numPixels_];
-	wx_ = new float[numPixels_];
-	wy_ = new float[numPixels_];
-	grad_ = new float[numPixels_];
+#ifdef _OPENMP
+	if (numThreads <= 0)
+	{
+		numThreads = omp_get_max_threads();
+	}
+#endif
+
+	// l starting at 1 and u at 0 as in calculateWeightAndGradient
+	WeightBounds bounds = {{1, 1, 1}, {0, 0, 0}};
+
+#pragma omp parallel num_threads(numThreads)
+	{
+		float l[3] = {1, 1, 1}, u[3] = {0, 0, 0};
+
+#pragma omp for schedule(static)
+		for (int y = 0; y < height; y++)
+		{
+			const float* row = image + size_t(y) * width;
+			// 0 past the last column and row, and for the gradient of the border pixels
+			const float* above = y > 0 ? row - width : row;
+			const float* below = y < height - 1 ? row + width : row;
+			const bool innerRow = y > 0 && y < height - 1;
+
+			for (int x = 0; x < width; x++)
+			{
+				const float v[3] = {
+					x < width - 1 ? std::fabs(row[x] - row[x + 1]) : 0.f,
+					std::fabs(row[x] - below[x]),
+					innerRow && x > 0 && x < width - 1 ?
+						std::fabs(row[x - 1] - row[x + 1]) + std::fabs(above[x] - below[x]) : 0.f
+				};
+				for (int i = 0; i < 3; i++)
+				{
+					l[i] = std::min(l[i], v[i]);
+					u[i] = std::max(u[i], v[i]);
+				}
+			}
+		}
+
+#pragma omp critical
+		for (int i = 0; i < 3; i++)
+		{
+			bounds.lower[i] = std::min(bounds.lower[i], l[i]);
+			bounds.upper[i] = std::max(bounds.upper[i], u[i]);
+		}
+	}
+
+	return bounds;
+}
+
+void CRWCRSolver::setParameters(const Parameters& parameters)
+{
+	parameters_ = parameters;
+}
+
+void CRWCRSolver::copySeeds()
+{
+	grown_.assign(seeds_->getSeedBuffer(), width_, height_);
+	labels_ = grown_.getSeedBuffer();
+}
+
+void CRWCRSolver::setProgressCallback(const std::function<void(int, int)>& callback)
+{
+	progress_ = callback;
+}
+
+void CRWCRSolver::setIntermediateCallback(const std::function<void(const float*)>& callback)
+{
+	intermediate_ = callback;
+}
+
+void CRWCRSolver::cancel()
+{
+	cancelled_ = true;
+}
+
+bool CRWCRSolver::isCancelled() const
+{
+	return cancelled_;
+}
+
+void CRWCRSolver::solve()
+{
+	PROFILE_SCOPE("solve");
+	auto start = std::chrono::steady_clock::now();
+	cancelled_ = false;
+
+	copySeeds();
+	progressBase_ = 0;
+	progressTotal_ = parameters_.maxIterations1D + parameters_.maxIterations2D;
+	initialization({0, 0, width_, height_});
+
+	progressBase_ = parameters_.maxIterations1D;
+	if (!cancelRequested())
+	{
+		solveLevel(parameters_.pyramidLevels);
+	}
+
+	std::chrono::duration<float, std::milli> diff = std::chrono::steady_clock::now() - start;
+	time_ = diff.count();
+}
+
+void CRWCRSolver::solveIncremental(const SeedRegion& region)
+{
+	PROFILE_SCOPE("incremental solve");
+	auto start = std::chrono::steady_clock::now();
+
+	cancelled_ = false;
+	iterations_ = 0;
+	residual_ = 0;
+	progressBase_ = 0;
+	progressTotal_ = parameters_.maxIterations1D + parameters_.maxIterations2D;
+
+	if (region.x0 < region.x1 && region.y0 < region.y1)
+	{
+		const int margin = parameters_.incrementalMargin;
+		SeedRegion window;
+		window.x0 = std::max(region.x0 - margin, 0);
+		window.y0 = std::max(region.y0 - margin, 0);
+		window.x1 = std::min(region.x1 + margin, width_);
+		window.y1 = std::min(region.y1 + margin, height_);
+
+		// the foreground grown in the window may have crossed pixels the new strokes take, so the
+		// window goes back to the seeds and is grown again
+		const unsigned char* seeds = seeds_->getSeedBuffer();
+		for (int y = window.y0; y < window.y1; y++)
+		{
+			for (int x = window.x0; x < window.x1; x++)
+			{
+				const size_t index = x + size_t(y) * width_;
+				if (seeds[index] != 0)
+				{
+					grown_.setLabel(x, y, seeds[index]);
+				}
+				else
+				{
+					labels_[index] = 0;
+				}
+			}
+		}
+		initialization(window);
+
+		progressBase_ = parameters_.maxIterations1D;
+		if (!cancelRequested())
+		{
+			prwindow(window, parameters_.maxIterations2D);
+		}
+	}
+
+	std::chrono::duration<float, std::milli> diff = std::chrono::steady_clock::now() - start;
+	time_ = diff.count();
+}
+
+void CRWCRSolver::solveLevel(int levels)
+{
+	const int minPyramidSize = 64;
+	const int cw = (width_ + 1) / 2, ch = (height_ + 1) / 2;
+
+	if (levels <= 1 || cw < minPyramidSize || ch < minPyramidSize)
+	{
+		prcorrection(parameters_.maxIterations2D, false);
+		return;
+	}
+
+	// solve the same problem at half resolution first: the grown seeds of this level and its
+	// weights restricted, so that the coarse map approximates the map of this level
+	unsigned char* coarseLabels = new unsigned char[size_t(cw) * ch];
+	downsampleSeeds(labels_, width_, height_, coarseLabels);
+
+	{
+		SeedBuffer coarseSeeds(coarseLabels, cw, ch);
+		coarseSeeds.updateSpans();
+
+		// the coarse levels stop on a cancel of this solver, only this level reports progress
+		CRWCRSolver coarse(*this, &coarseSeeds);
+		coarse.solveLevel(levels - 1);
+
+		upsampleProbability(coarse.solution_, cw, ch, solution_, width_, height_);
+	}
+
+	delete[] coarseLabels;
+
+	// the upsampled map is already close, a few warm-started iterations refine the boundary
+	progressTotal_ = progressBase_ + parameters_.refineIterations2D;
+	if (!cancelRequested())
+	{
+		prcorrection(parameters_.refineIterations2D, true);
+	}
+}
+
+void CRWCRSolver::solveMultiLabel(SeedBuffer* seeds, int numLabels)
+{
+	PROFILE_SCOPE("multi-label solve");
+	auto start = std::chrono::steady_clock::now();
+	cancelled_ = false;
+
+	seeds_ = seeds;
+	copySeeds();
+
+	if (numLabels_ != numLabels)
+	{
+		numLabels_ = numLabels;
+		delete[] labelSolution_;
+		labelSolution_ = new float[numPixels_ * numLabels_];
+	}
+
+	progressBase_ = 0;
+	progressTotal_ = parameters_.maxIterations1D + parameters_.maxIterations2D;
+	initializationMultiLabel(numLabels_);
+
+	progressBase_ = parameters_.maxIterations1D;
+	if (!cancelRequested())
+	{
+		prcorrectionMultiLabel(numLabels_, parameters_.maxIterations2D);
+	}
+
+	std::chrono::duration<float, std::milli> diff = std::chrono::steady_clock::now() - start;
+	time_ = diff.count();
+}
+
+const float* CRWCRSolver::getLabelProbability(int label) const
+{
+	return labelSolution_ + size_t(label - 1) * numPixels_;
+}
+
+unsigned char* CRWCRSolver::generateLabelImage()
+{
+	if (labelImage_ == nullptr)
+	{
+		labelImage_ = new unsigned char[numPixels_];
+	}
+
+#pragma omp parallel for num_threads(numThreads())
+	for (int y = 0; y < height_; y++)
+	{
+		for (size_t i = size_t(y) * width_; i < size_t(y + 1) * width_; i++)
+		{
+			unsigned char label = 1;
+			float best = labelSolution_[i];
+			for (int k = 1; k < numLabels_; k++)
+			{
+				if (labelSolution_[i + k * numPixels_] > best)
+				{
+					best = labelSolution_[i + k * numPixels_];
+					label = static_cast<unsigned char>(k + 1);
+				}
+			}
+			labelImage_[i] = label;
+		}
+	}
+
+	return labelImage_;
+}
+
+float* CRWCRSolver::generateProbabilityImage() const
+{
+	return solution_;
+}
+
+unsigned short* CRWCRSolver::generateProbabilityImage16()
+{
+	if (probability16_ == nullptr)
+	{
+		probability16_ = new unsigned short[numPixels_];
+	}
+
+#pragma omp parallel for num_threads(numThreads())
+	for (int y = 0; y < height_; y++)
+	{
+		const size_t begin = size_t(y) * width_;
+		for (int x = 0; x < width_; x++)
+		{
+			const float p = std::min(std::max(solution_[begin + x], 0.f), 1.f);
+			probability16_[begin + x] = static_cast<unsigned short>(p * 65535.f + 0.5f);
+		}
+	}
+
+	return probability16_;
+}
+
+float CRWCRSolver::getUseTime() const
+{
+	return time_;
+}
+
+int CRWCRSolver::getIterations() const
+{
+	return iterations_;
+}
+
+float CRWCRSolver::getResidual() const
+{
+	return residual_;
+}
+
+void CRWCRSolver::initialization(const SeedRegion& window)
+{
+	PROFILE_SCOPE("1D initialization");
+	const int lanes = BatchTDMA::numLanes;
+	int maxSize = width_ >= height_ ? width_ : height_;
+
+	// lines whose interior seeds changed since they were last solved. A line only reads its own
+	// seeds, so solving an unchanged line again cannot add foreground.
+	unsigned char* rowDirty = new unsigned char[height_];
+	unsigned char* colDirty = new unsigned char[width_];
+	std::fill(rowDirty, rowDirty + height_, 0);
+	std::fill(colDirty, colDirty + width_, 0);
+
+	// dirty lines of the running pass, solved numLanes at a time
+	int* lines = new int[maxSize];
+	int numLines = 0;
+	bool stop = false;
+
+	// when few lines are dirty they are split among the threads
+	PartitionedLines partitioned;
+	int numChunks = 1;
+
+	// within a pass every line writes only its own seeds, so the lines are shared out among threads
+#pragma omp parallel num_threads(numThreads())
+	{
+		float* a = new float[maxSize * lanes];
+		float* b = new float[maxSize * lanes];
+		float* c = new float[maxSize * lanes];
+		float* d = new float[maxSize * lanes];
+		float* solution = new float[maxSize * lanes];
+
+		// the lines through the window crossing a foreground seed start dirty, the seed spans skip
+		// the rows without seeds
+#pragma omp for schedule(static)
+		for (int y = 1; y < height_ - 1; y++)
+		{
+			const bool windowRow = y >= window.y0 && y < window.y1;
+			const SeedSpan& span = grown_.getRowSpan(y);
+			const int begin = std::max(span.begin, windowRow ? 1 : std::max(window.x0, 1));
+			const int end = std::min(span.end, windowRow ? width_ - 1 : std::min(window.x1, width_ - 1));
+			for (int x = begin; x < end; x++)
+			{
+				if (labels_[x + size_t(y) * width_] == 1)
+				{
+					if (windowRow)
+					{
+						rowDirty[y] = 1;
+					}
+					if (x >= window.x0 && x < window.x1)
+					{
+#pragma omp atomic write
+						colDirty[x] = 1;
+					}
+				}
+			}
+		}
+
+		for (int i = 0; i < parameters_.maxIterations1D; i++)
+		{
+			PROFILE_START(iterationStart);
+
+			for (int pass = 0; pass < 2; pass++)
+			{
+				// rows in the first pass, columns in the second
+				const int numRow = pass == 0 ? width_ : height_;
+				const size_t stride = pass == 0 ? 1 : width_;
+				const size_t lineStride = pass == 0 ? width_ : 1;
+				const WeightType* w = pass == 0 ? wx_ : wy_;
+				unsigned char* dirty = pass == 0 ? rowDirty : colDirty;
+				unsigned char* crossDirty = pass == 0 ? colDirty : rowDirty;
+				// only the nodes inside the window grow
+				const int growBegin = pass == 0 ? window.x0 : window.y0;
+				const int growEnd = pass == 0 ? window.x1 : window.y1;
+
+#pragma omp single
+				{
+					numLines = collectLines(dirty, pass == 0 ? height_ : width_, lines);
+					numChunks = lineChunks((numLines + lanes - 1) / lanes, numRow);
+					if (numChunks > 1)
+					{
+						partitioned.resize((numLines + lanes - 1) / lanes, numRow, numChunks);
+					}
+				}
+
+				const int numBatches = (numLines + lanes - 1) / lanes;
+
+				auto assemble = [&](int batch, int begin, int end, float* lower, float* central, float* upper,
+				                    float* rhs)
+				{
+					for (int l = 0; l < lanes; l++)
+					{
+						const int index = batch * lanes + l;
+						if (index < numLines)
+						{
+							assemble1DLine(w + size_t(lines[index]) * numRow, lines[index] * lineStride, stride, numRow,
+							               begin, end, lower + l, central + l, upper + l, rhs + l);
+						}
+						else
+						{
+							const int k = begin * lanes + l;
+							clearLane(lower + k, central + k, upper + k, rhs + k, end - begin);
+						}
+					}
+				};
+
+				// the nodes [begin, end) of the lines of a batch above the threshold become foreground
+				auto grow = [&](int batch, int begin, int end, const float* x)
+				{
+					for (int l = 0; l < lanes && batch * lanes + l < numLines; l++)
+					{
+						const int line = lines[batch * lanes + l];
+						for (int r = std::max(begin, growBegin); r < std::min(end, growEnd); r++)
+						{
+							unsigned char& label = labels_[line * lineStride + r * stride];
+							if (x[r * lanes + l] >= parameters_.foreThreshold && label != 1)
+							{
+								label = 1;
+								// the border nodes are not part of any line system, and a split line
+								// is grown by several threads
+								if (r > 0 && r < numRow - 1)
+								{
+#pragma omp atomic write
+									dirty[line] = 1;
+#pragma omp atomic write
+									crossDirty[r] = 1;
+								}
+							}
+						}
+					}
+				};
+
+				if (numChunks > 1)
+				{
+					partitionedSweep(partitioned, assemble, grow);
+				}
+				else
+				{
+#pragma omp for schedule(static)
+					for (int batch = 0; batch < numBatches; batch++)
+					{
+						assemble(batch, 0, numRow, a, b, c, d);
+
+						// solve equation
+						BatchTDMA::solve(a, b, c, d, solution, numRow);
+
+						grow(batch, 0, numRow, solution);
+					}
+				}
+			}
+
+#pragma omp single
+			{
+				// a pass that added no foreground leaves nothing to solve
+				stop = cancelRequested() ||
+					(std::count(rowDirty, rowDirty + height_, 1) == 0 && std::count(colDirty, colDirty + width_, 1) == 0);
+				reportProgress(i + 1);
+			}
+			PROFILE_RECORD_MASTER("1D iteration", iterationStart);
+
+			if (stop)
+			{
+				break;
+			}
+		}
+
+		delete[] a;
+		delete[] b;
+		delete[] c;
+		delete[] d;
+		delete[] solution;
+	}
+
+	// PR skips the seed lookups outside the spans of the grown labels
+	grown_.updateSpans();
+
+	delete[] rowDirty;
+	delete[] colDirty;
+	delete[] lines;
+}
+
+void CRWCRSolver::initializationMultiLabel(int numLabels)
+{
+	PROFILE_SCOPE("1D initialization");
+	const int lanes = BatchTDMA::numLanes;
+	int maxSize = width_ >= height_ ? width_ : height_;
+
+	// lines containing a seed of any label, solved numLanes at a time
+	int* lines = new int[maxSize];
+
+	for (int i = 0; i < parameters_.maxIterations1D && !cancelRequested(); i++)
+	{
+		PROFILE_SCOPE("1D iteration");
+
+		for (int pass = 0; pass < 2; pass++)
+		{
+			// rows in the first pass, columns in the second
+			const int numLines = pass == 0 ? height_ : width_;
+			const int numRow = pass == 0 ? width_ : height_;
+			const size_t stride = pass == 0 ? 1 : width_;
+			const size_t lineStride = pass == 0 ? width_ : 1;
+			const WeightType* w = pass == 0 ? wx_ : wy_;
+
+			int count = 0;
+			for (int line = 1; line < numLines - 1; line++)
+			{
+				const SeedSpan& span = pass == 0 ? grown_.getRowSpan(line) : grown_.getColumnSpan(line);
+				const int end = std::min(span.end, numRow - 1);
+				for (int r = std::max(span.begin, 1); r < end; r++)
+				{
+					if (labels_[line * lineStride + r * stride] != 0)
+					{
+						lines[count++] = line;
+						break;
+					}
+				}
+			}
+
+			const int numBatches = (count + lanes - 1) / lanes;
+
+			// within a pass every line reads and writes only its own labels, so the batches are
+			// shared out among threads
+#pragma omp parallel num_threads(numThreads())
+			{
+				float* a = new float[maxSize * lanes];
+				float* b = new float[maxSize * lanes];
+				float* c = new float[maxSize * lanes];
+				float* d = new float[maxSize * lanes];
+				float* upper = new float[maxSize * lanes];
+				float* pivot = new float[maxSize * lanes];
+
+				// right vectors of all labels, node by node
+				float* rhs = new float[size_t(maxSize) * numLabels * lanes];
+
+#pragma omp for schedule(static)
+				for (int batch = 0; batch < numBatches; batch++)
+				{
+					const int first = batch * lanes;
+					for (int l = 0; l < lanes; l++)
+					{
+						if (first + l < count)
+						{
+							const int line = lines[first + l];
+							assemble1DLine(w + size_t(line) * numRow, line * lineStride, stride, numRow, 0, numRow,
+							               a + l, b + l, c + l, d + l);
+						}
+						else
+						{
+							clearLane(a + l, b + l, c + l, d + l, numRow);
+						}
+
+						for (int r = 0; r < numRow; r++)
+						{
+							const unsigned char label = first + l < count && r > 0 && r < numRow - 1
+								                            ? labels_[lines[first + l] * lineStride + r * stride]
+								                            : 0;
+							for (int k = 0; k < numLabels; k++)
+							{
+								rhs[(size_t(r) * numLabels + k) * lanes + l] = label == k + 1 ? parameters_.lambda1D : 0;
+							}
+						}
+					}
+
+					BatchTDMA::factorize(a, b, c, upper, pivot, numRow);
+					BatchTDMA::substitute(a, upper, pivot, rhs, numRow, numLabels);
+
+					// an unlabeled pixel joins the first label above the threshold
+					for (int l = 0; l < lanes && first + l < count; l++)
+					{
+						const size_t start = lines[first + l] * lineStride;
+						for (int r = 0; r < numRow; r++)
+						{
+							unsigned char& label = labels_[start + r * stride];
+							if (label != 0)
+							{
+								continue;
+							}
+							for (int k = 0; k < numLabels; k++)
+							{
+								if (rhs[(size_t(r) * numLabels + k) * lanes + l] >= parameters_.foreThreshold)
+								{
+									label = static_cast<unsigned char>(k + 1);
+									break;
+								}
+							}
+						}
+					}
+				}
+
+				delete[] a;
+				delete[] b;
+				delete[] c;
+				delete[] d;
+				delete[] upper;
+				delete[] pivot;
+				delete[] rhs;
+			}
+
+			// the labels were written past the spans, the next pass finds its lines through them
+			grown_.updateSpans();
+		}
+
+		reportProgress(i + 1);
+	}
+
+	delete[] lines;
+}
+
+void CRWCRSolver::prcorrection(int maxIterations, bool warmStart)
+{
+	PROFILE_SCOPE("PR");
+	const int lanes = BatchTDMA::numLanes;
+	int maxSize = width_ >= height_ ? width_ : height_;
+
+	// the explicit half step amplifies edges between unseeded pixels by about w / dt, which the
+	// seed mask has none of but an earlier result does
+	dt_ = warmStart ? parameters_.warmStartDt : parameters_.dt;
+
+	for (size_t i = 0; i < numPixels_; i++)
+	{
+		if (!warmStart || labels_[i] != 0)
+		{
+			solution_[i] = labels_[i] == 1;
+		}
+	}
+
+	// the seeds as grown by the 1D initialization
+	publishIntermediate();
+
+	// the row sweep reads solution_ and writes the half step into u_n, the column sweep
+	// reads u_n and writes solution_ back, so no copy is needed between sweeps
+	float* u_n = new float[numPixels_];
+
+	// max-norm change of each iteration
+	float* residuals = new float[std::max(maxIterations, 1)];
+	std::fill(residuals, residuals + std::max(maxIterations, 1), 0.f);
+	// set by cancel, shared by the team
+	bool stop = false;
+
+	// rows are independent inside a row sweep and columns inside a column sweep,
+	// so each thread works on its own batches of lines with private scratch arrays
+#pragma omp parallel num_threads(numThreads())
+	{
+		float* b = new float[maxSize * lanes];
+		float* c = new float[maxSize * lanes];
+		float* d = new float[maxSize * lanes];
+		float* factors = new float[3 * maxSize * lanes];
+		const float *upper, *pivot;
+
+		PROFILE_START(factorStart);
+		factorLines(factors, b, c);
+		PROFILE_RECORD_MASTER("line factorization", factorStart);
+
+		int iteration = 0;
+		while (iteration < maxIterations)
+		{
+			// largest change of this thread's pixels over the iteration
+			float delta = 0;
+
+			// row sweeping
+			PROFILE_START(rowSweep);
+#pragma omp for schedule(static)
+			for (int batch = 0; batch < numRowBatches_; batch++)
+			{
+				assembleRowRhs(batch, solution_, 1, d, lanes);
+
+				const int rows = std::min(lanes, height_ - batch * lanes);
+				rowFactors(batch, factors, b, c, upper, pivot);
+				BatchTDMA::substitute(wx_ + size_t(batch * lanes) * width_, width_, rows, upper, pivot, d, width_);
+
+				for (int x = 0; x < width_; x++)
+				{
+					for (int l = 0; l < rows; l++)
+					{
+						u_n[x + size_t(batch * lanes + l) * width_] = d[x * lanes + l];
+					}
+				}
+			}
+
+			PROFILE_RECORD_MASTER("PR row sweep", rowSweep);
+
+			// column sweeping, tile by tile
+			PROFILE_START(columnSweep);
+#pragma omp for schedule(static)
+			for (int batch = 0; batch < numColBatches_; batch++)
+			{
+				columnFactors(batch, factors, b, c, upper, pivot);
+				delta = std::max(delta, sweepColumnBatch(batch, upper, pivot, u_n, d));
+			}
+			PROFILE_RECORD_MASTER("PR column sweep", columnSweep);
+
+#pragma omp critical
+			residuals[iteration] = std::max(residuals[iteration], delta);
+
+			// one thread looks at the cancel request for the team, the barrier at the end of single
+			// also completes residuals
+#pragma omp single
+			{
+				stop = cancelRequested();
+				reportProgress(iteration + 1);
+				publishIntermediate();
+			}
+
+			if (stop || residuals[iteration++] < parameters_.tolerance2D)
+			{
+				break;
+			}
+		}
+
+#pragma omp single
+		{
+			iterations_ = iteration;
+			residual_ = iteration > 0 ? residuals[iteration - 1] : 0;
+		}
+
+		delete[] b;
+		delete[] c;
+		delete[] d;
+		delete[] factors;
+	}
+
+	delete[] u_n;
+	delete[] residuals;
+}
+
+void CRWCRSolver::prwindow(const SeedRegion& window, int maxIterations)
+{
+	PROFILE_SCOPE("PR window");
+	const int lanes = BatchTDMA::numLanes;
+	dt_ = parameters_.dt;
+	const int ww = window.x1 - window.x0, wh = window.y1 - window.y0;
+	const int maxSize = std::max(ww, wh);
+	const int rowBatches = (wh + lanes - 1) / lanes, colBatches = (ww + lanes - 1) / lanes;
+
+	// the window starts from its seed mask like a full solve, so that after as many iterations it
+	// matches the last result outside instead of running ahead of it
+	for (int y = window.y0; y < window.y1; y++)
+	{
+		for (int x = window.x0; x < window.x1; x++)
+		{
+			const size_t index = x + size_t(y) * width_;
+			solution_[index] = labels_[index] == 1;
+		}
+	}
+
+	publishIntermediate();
+
+	// row half step of the window pixels, the column sweep writes solution_ back
+	float* half = new float[size_t(ww) * wh];
+
+	float* residuals = new float[std::max(maxIterations, 1)];
+	std::fill(residuals, residuals + std::max(maxIterations, 1), 0.f);
+	// set by cancel, shared by the team
+	bool stop = false;
+
+	// a few long lines are split into chunks, so that every thread has work
+	const int rowChunks = lineChunks(rowBatches, ww), colChunks = lineChunks(colBatches, wh);
+	PartitionedLines rowLines, colLines;
+	if (rowChunks > 1)
+	{
+		rowLines.resize(rowBatches, ww, rowChunks);
+	}
+	if (colChunks > 1)
+	{
+		colLines.resize(colBatches, wh, colChunks);
+	}
+
+	// the window is small, so its line systems are solved directly instead of factored once
+#pragma omp parallel num_threads(numThreads())
+	{
+		float* a = new float[maxSize * lanes];
+		float* b = new float[maxSize * lanes];
+		float* c = new float[maxSize * lanes];
+		float* d = new float[maxSize * lanes];
+		float* x = new float[maxSize * lanes];
+
+		float delta = 0;
+
+		auto assembleRows = [&](int batch, int begin, int end, float* lower, float* central, float* upper, float* rhs)
+		{
+			const int rows = std::min(lanes, wh - batch * lanes);
+			for (int l = 0; l < lanes; l++)
+			{
+				if (l < rows)
+				{
+					assembleWindowRow(window, window.y0 + batch * lanes + l, begin, end, lower + l, central + l,
+					                  upper + l, rhs + l);
+				}
+				else
+				{
+					const int k = begin * lanes + l;
+					clearLane(lower + k, central + k, upper + k, rhs + k, end - begin);
+				}
+			}
+		};
+
+		auto storeRows = [&](int batch, int begin, int end, const float* solution)
+		{
+			const int rows = std::min(lanes, wh - batch * lanes);
+			for (int i = begin; i < end; i++)
+			{
+				for (int l = 0; l < rows; l++)
+				{
+					half[i + size_t(batch * lanes + l) * ww] = solution[i * lanes + l];
+				}
+			}
+		};
+
+		auto assembleColumns = [&](int batch, int begin, int end, float* lower, float* central, float* upper,
+		                           float* rhs)
+		{
+			const int columns = std::min(lanes, ww - batch * lanes);
+			for (int l = 0; l < lanes; l++)
+			{
+				if (l < columns)
+				{
+					assembleWindowColumn(window, window.x0 + batch * lanes + l, half, begin, end, lower + l,
+					                     central + l, upper + l, rhs + l);
+				}
+				else
+				{
+					const int k = begin * lanes + l;
+					clearLane(lower + k, central + k, upper + k, rhs + k, end - begin);
+				}
+			}
+		};
+
+		auto storeColumns = [&](int batch, int begin, int end, const float* solution)
+		{
+			const int columns = std::min(lanes, ww - batch * lanes);
+			for (int i = begin; i < end; i++)
+			{
+				const size_t row = window.x0 + batch * lanes + size_t(window.y0 + i) * width_;
+				for (int l = 0; l < columns; l++)
+				{
+					delta = std::max(delta, std::fabs(solution[i * lanes + l] - solution_[row + l]));
+					solution_[row + l] = solution[i * lanes + l];
+				}
+			}
+		};
 
-	calculateWeight();
-	calculateGradient();
-}
+		int iteration = 0;
+		while (iteration < maxIterations)
+		{
+			delta = 0;
 
-CRWCRSolver::~CRWCRSolver()
-{
-	delete[] solution_;
-	delete[] wx_;
-	delete[] wy_;
-	delete[] grad_;
-}
+			PROFILE_START(rowSweep);
+			if (rowChunks > 1)
+			{
+				partitionedSweep(rowLines, assembleRows, storeRows);
+			}
+			else
+			{
+#pragma omp for schedule(static)
+				for (int batch = 0; batch < rowBatches; batch++)
+				{
+					assembleRows(batch, 0, ww, a, b, c, d);
+					BatchTDMA::solve(a, b, c, d, x, ww);
+					storeRows(batch, 0, ww, x);
+				}
+			}
+			PROFILE_RECORD_MASTER("PR row sweep", rowSweep);
 
-void CRWCRSolver::setSeed(TwoLabelSeed* seed)
-{
-	seeds_ = seed;
-}
+			PROFILE_START(columnSweep);
+			if (colChunks > 1)
+			{
+				partitionedSweep(colLines, assembleColumns, storeColumns);
+			}
+			else
+			{
+#pragma omp for schedule(static)
+				for (int batch = 0; batch < colBatches; batch++)
+				{
+					assembleColumns(batch, 0, wh, a, b, c, d);
+					BatchTDMA::solve(a, b, c, d, x, wh);
+					storeColumns(batch, 0, wh, x);
+				}
+			}
+			PROFILE_RECORD_MASTER("PR column sweep", columnSweep);
 
-void CRWCRSolver::solve()
-{
-	auto start = std::chrono::system_clock::now();
+#pragma omp critical
+			residuals[iteration] = std::max(residuals[iteration], delta);
 
-	initialization();
-	prcorrection();
+			// one thread looks at the cancel request for the team, the barrier at the end of single
+			// also completes residuals
+#pragma omp single
+			{
+				stop = cancelRequested();
+				reportProgress(iteration + 1);
+				publishIntermediate();
+			}
 
-	auto stop = std::chrono::system_clock::now();
-	auto accurateTime = start - stop;
-	std::chrono::duration<double> diff = stop - start;
-	time_ = diff.count() * 1000;
-}
+			if (stop || residuals[iteration++] < parameters_.tolerance2D)
+			{
+				break;
+			}
+		}
 
-float* CRWCRSolver::generateProbabilityImage() const
-{
-	return solution_;
-}
+#pragma omp single
+		{
+			iterations_ = iteration;
+			residual_ = iteration > 0 ? residuals[iteration - 1] : 0;
+		}
 
-float CRWCRSolver::getUseTime() const
-{
-	return time_;
+		delete[] a;
+		delete[] b;
+		delete[] c;
+		delete[] d;
+		delete[] x;
+	}
+
+	delete[] half;
+	delete[] residuals;
 }
 
-void CRWCRSolver::initialization()
+void CRWCRSolver::prcorrectionMultiLabel(int numLabels, int maxIterations)
 {
-	std::cout << parameters_.maxIterations1D << std::endl;
+	PROFILE_SCOPE("PR multi-label");
+	const int lanes = BatchTDMA::numLanes;
+	dt_ = parameters_.dt;
 	int maxSize = width_ >= height_ ? width_ : height_;
 
-	double* a = new double[maxSize];
-	double* b = new double[maxSize];
-	double* c = new double[maxSize];
-	double* d = new double[maxSize];
-	double* solution = new double[maxSize];
-
-	for (size_t i = 0; i < parameters_.maxIterations1D; i++)
+	for (int k = 0; k < numLabels; k++)
 	{
-		//scan each row
-		for (size_t y = 1; y < height_ - 1; y++)
+		float* p = labelSolution_ + k * numPixels_;
+		for (size_t i = 0; i < numPixels_; i++)
 		{
-			for (int x = 1; x < width_ - 1; x++)
-			{
-				if (seeds_->isForegroundSeed(x + y * width_))
-				{
-					for (int r = 1; r < width_ - 1; r++)
-					{
-						a[r] = -wx_[r - 1 + y * width_];
-						c[r] = -wx_[r + y * width_];
-						b[r] = -(a[r] + c[r]) + (seeds_->isSeedPoint(r + y * width_) ? parameters_.lambda1D : 0) +
-							parameters_.gamma1D * grad_[r + y * width_];
-						d[r] = seeds_->isForegroundSeed(r + y * width_) ? parameters_.lambda1D : 0.f;
-					}
+			p[i] = labels_[i] == k + 1;
+		}
+	}
+
+	float* u_n = new float[numPixels_ * numLabels];
+
+	float* residuals = new float[std::max(maxIterations, 1)];
+	std::fill(residuals, residuals + std::max(maxIterations, 1), 0.f);
+	// set by cancel, shared by the team
+	bool stop = false;
+
+	// as prcorrection, with the right vectors of all labels interleaved node by node so that
+	// each batch is factored once and substituted for every label in one pass
+#pragma omp parallel num_threads(numThreads())
+	{
+		float* b = new float[maxSize * lanes];
+		float* c = new float[maxSize * lanes];
+		float* d = new float[size_t(maxSize) * numLabels * lanes];
+		float* factors = new float[3 * maxSize * lanes];
+		const float *upper, *pivot;
+		const int stride = numLabels * lanes;
 
-					a[0] = -1;
-					c[0] = a[1];
-					b[0] = -(a[0] + c[0]);
+		PROFILE_START(factorStart);
+		factorLines(factors, b, c);
+		PROFILE_RECORD_MASTER("line factorization", factorStart);
 
-					a[width_ - 1] = -wx_[width_ - 2 + y * width_];
-					c[width_ - 1] = -1;
-					b[width_ - 1] = -(a[width_ - 1] + c[width_ - 1]);
+		int iteration = 0;
+		while (iteration < maxIterations)
+		{
+			float delta = 0;
 
+			// row sweeping
+			PROFILE_START(rowSweep);
+#pragma omp for schedule(static)
+			for (int batch = 0; batch < numRowBatches_; batch++)
+			{
+				for (int k = 0; k < numLabels; k++)
+				{
+					assembleRowRhs(batch, labelSolution_ + k * numPixels_, k + 1, d + k * lanes, stride);
+				}
 
-					d[0] = d[width_ - 1] = 0;
-					// solve equation
-					TDMA(a, b, c, d, solution, width_);
+				const int rows = std::min(lanes, height_ - batch * lanes);
+				rowFactors(batch, factors, b, c, upper, pivot);
+				BatchTDMA::substitute(wx_ + size_t(batch * lanes) * width_, width_, rows, upper, pivot, d, width_,
+				                      numLabels);
 
-					for (int j = 0; j < width_; j++)
+				for (int k = 0; k < numLabels; k++)
+				{
+					float* u = u_n + k * numPixels_;
+					for (int x = 0; x < width_; x++)
 					{
-						if (solution[j] >= parameters_.foreThreshold)
+						for (int l = 0; l < rows; l++)
 						{
-							seeds_->setToForegroundSeed(j + y * width_);
+							u[x + size_t(batch * lanes + l) * width_] = d[x * stride + k * lanes + l];
 						}
 					}
-
-					break;
 				}
 			}
-		}
 
-		// scan each column
-		for (size_t x = 1; x < width_ - 1; x++)
-		{
-			for (size_t y = 1; y < height_ - 1; y++)
+			PROFILE_RECORD_MASTER("PR row sweep", rowSweep);
+
+			// column sweeping
+			PROFILE_START(columnSweep);
+#pragma omp for schedule(static)
+			for (int batch = 0; batch < numColBatches_; batch++)
 			{
-				if (seeds_->isForegroundSeed(x + y * width_))
+				for (int k = 0; k < numLabels; k++)
 				{
-					for (size_t col = 1; col < height_ - 1; col++)
-					{
-						a[col] = -wy_[col - 1 + x * height_];
-						c[col] = -wy_[col + x * height_];
-						b[col] = -(a[col] + c[col]) + (seeds_->isSeedPoint(x + col * width_) ? parameters_.lambda1D : 0)
-							+ parameters_.gamma1D * grad_[x + col * width_];
-						d[col] = seeds_->isForegroundSeed(x + col * width_) ? parameters_.lambda1D : 0.f;
-					}
-
-					a[0] = -1;
-					c[0] = a[1];
-					b[0] = -(a[0] + c[0]);
-
-					a[height_ - 1] = -wy_[height_ - 2 + y * width_];
-					c[height_ - 1] = -1;
-					b[height_ - 1] = -(a[height_ - 1] + c[height_ - 1]);
-
-					d[0] = d[height_ - 1] = 0;
+					assembleColumnRhs(batch, u_n + k * numPixels_, k + 1, d + k * lanes, stride);
+				}
 
-					// solve equation
-					TDMA(a, b, c, d, solution, height_);
+				const int columns = std::min(lanes, width_ - batch * lanes);
+				columnFactors(batch, factors, b, c, upper, pivot);
+				BatchTDMA::substitute(wy_ + size_t(batch * lanes) * height_, height_, columns, upper, pivot, d, height_,
+				                      numLabels);
 
-					for (int j = 0; j < height_; j++)
+				for (int k = 0; k < numLabels; k++)
+				{
+					float* p = labelSolution_ + k * numPixels_;
+					for (int y = 0; y < height_; y++)
 					{
-						if (solution[j] >= parameters_.foreThreshold)
+						const size_t row = batch * lanes + size_t(y) * width_;
+						for (int l = 0; l < columns; l++)
 						{
-							seeds_->setToForegroundSeed(x + j * width_);
+							const float value = d[y * stride + k * lanes + l];
+							delta = std::max(delta, std::fabs(value - p[row + l]));
+							p[row + l] = value;
 						}
 					}
-					break;
 				}
 			}
+			PROFILE_RECORD_MASTER("PR column sweep", columnSweep);
+
+#pragma omp critical
+			residuals[iteration] = std::max(residuals[iteration], delta);
+
+			// one thread looks at the cancel request for the team, the barrier at the end of single
+			// also completes residuals
+#pragma omp single
+			{
+				stop = cancelRequested();
+				reportProgress(iteration + 1);
+			}
+
+			if (stop || residuals[iteration++] < parameters_.tolerance2D)
+			{
+				break;
+			}
 		}
+
+#pragma omp single
+		{
+			iterations_ = iteration;
+			residual_ = iteration > 0 ? residuals[iteration - 1] : 0;
+		}
+
+		delete[] b;
+		delete[] c;
+		delete[] d;
+		delete[] factors;
 	}
 
-	delete[]a;
-	delete[]b;
-	delete[]c;
-	delete[]d;
-	delete[]solution;
+	delete[] u_n;
+	delete[] residuals;
 }
 
-void CRWCRSolver::prcorrection()
+bool CRWCRSolver::cancelRequested() const
 {
-	int maxSize = width_ >= height_ ? width_ : height_;
+	return cancelRequest_->load(std::memory_order_relaxed);
+}
 
-	for (size_t i = 0; i < numPixels_; i++)
+void CRWCRSolver::reportProgress(int done) const
+{
+	if (progress_)
 	{
-		solution_[i] = seeds_->isForegroundSeed(i);
+		progress_(progressBase_ + done, progressTotal_);
 	}
+}
 
-	double* a = new double[maxSize];
-	double* b = new double[maxSize];
-	double* c = new double[maxSize];
-	double* d = new double[maxSize];
-	double* solution = new double[maxSize];
+void CRWCRSolver::publishIntermediate() const
+{
+	if (intermediate_)
+	{
+		intermediate_(solution_);
+	}
+}
 
-	float* u_n = new float[numPixels_];
-	memcpy(u_n, solution_, numPixels_ * sizeof(float));
+int CRWCRSolver::numThreads() const
+{
+#ifdef _OPENMP
+	return parameters_.numThreads > 0 ? parameters_.numThreads : omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
 
-	for (size_t i = 0; i < parameters_.maxIterations2D; i++)
+int CRWCRSolver::lineChunks(int numBatches, int numRow) const
+{
+	const int threads = numThreads();
+	if (numBatches == 0 || numBatches >= threads)
 	{
-		// row sweeping
-		for (size_t y = 0; y < height_; y++)
-		{
-			for (size_t x = 0; x < width_; x++)
-			{
-				const int index = x + y * width_;
+		return 1;
+	}
+	return std::max(1, std::min(threads / numBatches, numRow / minChunkRows));
+}
 
-				if (x == 0)
-				{
-					a[x] = -1;
-					c[x] = -wx_[y * width_];
-					b[x] = -(c[x] + a[x]);
-				}
-				else if (x == width_ - 1)
-				{
-					a[x] = -wx_[index - 1];
-					c[x] = -1;
-					b[x] = -(a[x] + c[x]);
-				}
-				else
-				{
-					a[x] = -wx_[index - 1];
-					c[x] = -wx_[index];
-					b[x] = -(a[x] + c[x]) + parameters_.gamma2D * grad_[index] +
-						(seeds_->isSeedPoint(x + y * width_) ? parameters_.lambda2D : 0) + parameters_.dt;
-				}
+void CRWCRSolver::factorLines(float* a, float* b, float* c)
+{
+#ifndef CRWCR_COMPACT_MEMORY
+	const int lanes = BatchTDMA::numLanes;
 
-				float a_, b_, c_;
+	// the system matrices do not change between iterations, factor them once
+#pragma omp for schedule(static)
+	for (int batch = 0; batch < numRowBatches_; batch++)
+	{
+		const size_t offset = size_t(batch) * width_ * lanes;
+		factorRowBatch(batch, a, rowUpper_ + offset, rowPivot_ + offset, b, c);
+	}
 
-				if (y == 0)
-				{
-					a_ = -1;
-					c_ = -wy_[x * height_];
-					b_ = -(c_ + a_);
-					d[x] = (seeds_->isForegroundSeed(x + y * width_) ? parameters_.lambda2D : 0) - (u_n[index] * b_ +
-						u_n[x + width_] * c_) + u_n[index] * parameters_.dt;
-				}
-				else if (y == height_ - 1)
-				{
-					a_ = -wy_[height_ - 2 + x * height_];
-					c_ = -1;
-					b_ = -(a_ + c_);
-					d[x] = (seeds_->isForegroundSeed(x + y * width_) ? parameters_.lambda2D : 0) - (u_n[x + (y - 1) *
-						width_] * a_ + u_n[index] * b_) + u_n[index] * parameters_.dt;
-				}
-				else
-				{
-					a_ = -wy_[y - 1 + x * height_];
-					c_ = -wy_[y + x * height_];
-					b_ = -(a_ + c_);
-					d[x] = (seeds_->isForegroundSeed(x + y * width_) ? parameters_.lambda2D : 0) - (u_n[x + (y - 1) *
-						width_] * a_ + u_n[index] * b_ + u_n[x + (y + 1) * width_] * c_) + u_n[index] * parameters_.dt;
-				}
-			}
+#pragma omp for schedule(static)
+	for (int batch = 0; batch < numColBatches_; batch++)
+	{
+		const size_t offset = size_t(batch) * height_ * lanes;
+		factorColumnBatch(batch, a, colUpper_ + offset, colPivot_ + offset, b, c);
+	}
+#endif
+}
 
-			// TDMA
-			TDMA(a, b, c, d, solution, width_);
+void CRWCRSolver::rowFactors(int batch, float* scratch, float* b, float* c, const float*& upper, const float*& pivot)
+{
+#ifdef CRWCR_COMPACT_MEMORY
+	// the factors are rebuilt batch by batch in every sweep instead of being kept for all lines
+	const size_t size = size_t(width_) * BatchTDMA::numLanes;
+	factorRowBatch(batch, scratch, scratch + size, scratch + 2 * size, b, c);
+	upper = scratch + size;
+	pivot = scratch + 2 * size;
+#else
+	const size_t offset = size_t(batch) * width_ * BatchTDMA::numLanes;
+	upper = rowUpper_ + offset;
+	pivot = rowPivot_ + offset;
+#endif
+}
 
-			for (size_t x = 0; x < width_; x++)
-			{
-				solution_[x + y * width_] = solution[x];
-			}
-		}
+void CRWCRSolver::columnFactors(int batch, float* scratch, float* b, float* c, const float*& upper,
+                                const float*& pivot)
+{
+#ifdef CRWCR_COMPACT_MEMORY
+	const size_t size = size_t(height_) * BatchTDMA::numLanes;
+	factorColumnBatch(batch, scratch, scratch + size, scratch + 2 * size, b, c);
+	upper = scratch + size;
+	pivot = scratch + 2 * size;
+#else
+	const size_t offset = size_t(batch) * height_ * BatchTDMA::numLanes;
+	upper = colUpper_ + offset;
+	pivot = colPivot_ + offset;
+#endif
+}
 
-		memcpy(u_n, solution_, numPixels_ * sizeof(float));
+void CRWCRSolver::factorRowBatch(int batch, float* lower, float* upper, float* pivot, float* b, float* c)
+{
+	const int lanes = BatchTDMA::numLanes;
 
-		// column sweeping
-		for (size_t x = 0; x < width_; x++)
+	for (int l = 0; l < lanes; l++)
+	{
+		const int y = batch * lanes + l;
+		if (y < height_)
 		{
-			for (size_t y = 0; y < height_; y++)
-			{
-				int index = x + y * width_;
+			assemblePRLine(wx_ + size_t(y) * width_, size_t(y) * width_, 1, width_, 0, width_, lower + l, b + l, c + l);
+		}
+		else
+		{
+			clearLane(lower + l, b + l, c + l, nullptr, width_);
+		}
+	}
+	BatchTDMA::factorize(lower, b, c, upper, pivot, width_);
+}
 
-				if (y == 0)
-				{
-					a[y] = -1;
-					c[y] = -wy_[x * height_];
-					b[y] = -(c[y] + a[y]);
-				}
-				else if (y == height_ - 1)
-				{
-					a[y] = -wy_[height_ - 2 + x * height_];
-					c[y] = -1;
-					b[y] = -(a[y] + c[y]);
-				}
-				else
-				{
-					a[y] = -wy_[y - 1 + x * height_];
-					c[y] = -wy_[y + x * height_];
-					b[y] = -(a[y] + c[y]) + parameters_.gamma2D * grad_[index] + (seeds_->isSeedPoint(x + y * width_)
-						                                                              ? parameters_.lambda2D
-						                                                              : 0) + parameters_.dt;
-				}
+void CRWCRSolver::factorColumnBatch(int batch, float* lower, float* upper, float* pivot, float* b, float* c)
+{
+	const int lanes = BatchTDMA::numLanes;
 
-				float a_, b_, c_;
+	for (int l = 0; l < lanes; l++)
+	{
+		const int x = batch * lanes + l;
+		if (x < width_)
+		{
+			assemblePRLine(wy_ + size_t(x) * height_, x, width_, height_, 0, height_, lower + l, b + l, c + l);
+		}
+		else
+		{
+			clearLane(lower + l, b + l, c + l, nullptr, height_);
+		}
+	}
+	BatchTDMA::factorize(lower, b, c, upper, pivot, height_);
+}
 
-				if (x == 0)
-				{
-					a_ = -1;
-					c_ = -wx_[index];
-					b_ = -(c_ + a_);
-					d[y] = (seeds_->isForegroundSeed(x + y * width_) ? parameters_.lambda2D : 0) - (u_n[y * width_] * b_
-						+ u_n[1 + y * width_] * c_) + u_n[index] * parameters_.dt;
-				}
-				else if (x == width_ - 1)
-				{
-					a_ = -wx_[index - 1];
-					c_ = -1;
-					b_ = -(a_ + c_);
-					d[y] = (seeds_->isForegroundSeed(x + y * width_) ? parameters_.lambda2D : 0) - (u_n[x - 1 + y *
-						width_] * a_ + u_n[x + y * width_] * b_) + u_n[index] * parameters_.dt;
-				}
-				else
-				{
-					a_ = -wx_[index - 1];
-					c_ = -wx_[index];
-					b_ = -(a_ + c_);
-					d[y] = (seeds_->isForegroundSeed(x + y * width_) ? parameters_.lambda2D : 0) - (u_n[x - 1 + y *
-							width_] * a_ + u_n[x + y * width_] * b_ + u_n[x + 1 + y * width_] * c_) + u_n[index] *
-						parameters_.dt;
-				}
-			}
-			// TDMA
-			TDMA(a, b, c, d, solution, height_);
+void CRWCRSolver::assemble1DLine(const WeightType* w, size_t start, size_t stride, int numRow, int begin, int end,
+                                 float* a, float* b, float* c, float* d)
+{
+	const int lanes = BatchTDMA::numLanes;
 
-			for (int y = 0; y < height_; y++)
-			{
-				solution_[x + y * width_] = solution[y];
-			}
-		}
+	for (int r = std::max(begin, 1); r < std::min(end, numRow - 1); r++)
+	{
+		const size_t index = start + r * stride;
+		const int k = r * lanes;
+		a[k] = -toFloat(w[r - 1]);
+		c[k] = -toFloat(w[r]);
+		b[k] = -(a[k] + c[k]) + (labels_[index] != 0 ? parameters_.lambda1D : 0) +
+			parameters_.gamma1D * toFloat(grad_[index]);
+		d[k] = labels_[index] == 1 ? parameters_.lambda1D : 0.f;
+	}
 
-		memcpy(u_n, solution_, numPixels_ * sizeof(float));
+	if (begin == 0)
+	{
+		a[0] = -1;
+		c[0] = -toFloat(w[0]);
+		b[0] = -(a[0] + c[0]);
+		d[0] = 0;
 	}
 
-	delete[] a;
-	delete[] c;
-	delete[] b;
-	delete[] d;
-	delete[] solution;
-	delete[] u_n;
+	if (end == numRow)
+	{
+		const int last = (numRow - 1) * lanes;
+		a[last] = -toFloat(w[numRow - 2]);
+		c[last] = -1;
+		b[last] = -(a[last] + c[last]);
+		d[last] = 0;
+	}
 }
 
-void CRWCRSolver::TDMA(double* a, double* b, double* c, double* d, double* x, int numRow)
+void CRWCRSolver::assemblePRLine(const WeightType* w, size_t start, size_t stride, int numRow, int begin, int end,
+                                 float* a, float* b, float* c)
 {
-	c[0] = c[0] / b[0];
-	d[0] = d[0] / b[0];
+	const int lanes = BatchTDMA::numLanes;
+
+	// first node
+	if (begin == 0)
+	{
+		a[0] = -1;
+		c[0] = -toFloat(w[0]);
+		b[0] = -(a[0] + c[0]);
+	}
 
-	// forward sweep
-	for (int i = 1; i < numRow; ++i)
+	for (int r = std::max(begin, 1); r < std::min(end, numRow - 1); r++)
 	{
-		double id = 1.0 / (b[i] - c[i - 1] * a[i]);
-		c[i] = c[i] * id;
-		d[i] = (d[i] - a[i] * d[i - 1]) * id;
+		const size_t index = start + r * stride;
+		const int k = (r - begin) * lanes;
+		a[k] = -toFloat(w[r - 1]);
+		c[k] = -toFloat(w[r]);
+		b[k] = -(a[k] + c[k]) + parameters_.gamma2D * toFloat(grad_[index]) +
+			(labels_[index] != 0 ? parameters_.lambda2D : 0) + dt_;
 	}
 
-	// backward sweep
-	x[numRow - 1] = d[numRow - 1];
-	for (int i = numRow - 2; i > -1; i--)
+	// last node
+	if (end == numRow)
 	{
-		x[i] = d[i] - c[i] * x[i + 1];
+		const int last = (numRow - 1 - begin) * lanes;
+		a[last] = -toFloat(w[numRow - 2]);
+		c[last] = -1;
+		b[last] = -(a[last] + c[last]);
 	}
 }
 
-void CRWCRSolver::normalize(float* data, size_t length)
+void CRWCRSolver::assembleWindowRow(const SeedRegion& window, int y, int begin, int end, float* a, float* b,
+                                    float* c, float* d)
 {
-	float l = 1, u = 0;
-	for (size_t i = 0; i < length; i++)
+	const int lanes = BatchTDMA::numLanes;
+	const int n = window.x1 - window.x0;
+	const size_t row = size_t(y) * width_;
+
+	assemblePRLine(wx_ + row, row, 1, width_, window.x0 + begin, window.x0 + end, a + begin * lanes, b + begin * lanes,
+	               c + begin * lanes);
+
+	// explicit vertical term from the last full step, u = 0 and w = 1 outside the image
+	for (int x = window.x0 + begin; x < window.x0 + end; x++)
 	{
-		l = std::min(l, data[i]);
-		u = std::max(u, data[i]);
+		const size_t index = row + x;
+		const float u = solution_[index];
+		const float uUp = y > 0 ? solution_[index - width_] : 0;
+		const float uDown = y < height_ - 1 ? solution_[index + width_] : 0;
+		const float wUp = y > 0 ? toFloat(wy_[y - 1 + size_t(x) * height_]) : 1;
+		const float wDown = y < height_ - 1 ? toFloat(wy_[y + size_t(x) * height_]) : 1;
+
+		d[(x - window.x0) * lanes] = (labels_[index] == 1 ? parameters_.lambda2D : 0) +
+			wUp * (uUp - u) + wDown * (uDown - u) + u * dt_;
 	}
 
-	if (fabs(l - u) < 1e-6)
+	// the neighbours outside the window are known
+	if (begin == 0 && window.x0 > 0)
 	{
-		return;
+		d[0] -= a[0] * solution_[row + window.x0 - 1];
+		a[0] = 0;
+	}
+	if (end == n && window.x1 < width_)
+	{
+		d[(n - 1) * lanes] -= c[(n - 1) * lanes] * solution_[row + window.x1];
+		c[(n - 1) * lanes] = 0;
+	}
+}
+
+void CRWCRSolver::assembleWindowColumn(const SeedRegion& window, int x, const float* half, int begin, int end,
+                                       float* a, float* b, float* c, float* d)
+{
+	const int lanes = BatchTDMA::numLanes;
+	const int n = window.y1 - window.y0;
+	const int ww = window.x1 - window.x0;
+
+	assemblePRLine(wy_ + size_t(x) * height_, x, width_, height_, window.y0 + begin, window.y0 + end,
+	               a + begin * lanes, b + begin * lanes, c + begin * lanes);
+
+	// explicit horizontal term from the half step, which outside the window is the last result
+	for (int y = window.y0 + begin; y < window.y0 + end; y++)
+	{
+		const size_t index = x + size_t(y) * width_;
+		const float* h = half + size_t(y - window.y0) * ww - window.x0;
+		const float u = h[x];
+		const float uLeft = x > window.x0 ? h[x - 1] : x > 0 ? solution_[index - 1] : 0;
+		const float uRight = x < window.x1 - 1 ? h[x + 1] : x < width_ - 1 ? solution_[index + 1] : 0;
+		const float wLeft = x > 0 ? toFloat(wx_[index - 1]) : 1;
+		const float wRight = x < width_ - 1 ? toFloat(wx_[index]) : 1;
+
+		d[(y - window.y0) * lanes] = (labels_[index] == 1 ? parameters_.lambda2D : 0) +
+			wLeft * (uLeft - u) + wRight * (uRight - u) + u * dt_;
 	}
 
-	for (size_t i = 0; i < length; i++)
-		data[i] = (data[i] - l) / (u - l);
+	if (begin == 0 && window.y0 > 0)
+	{
+		d[0] -= a[0] * solution_[x + size_t(window.y0 - 1) * width_];
+		a[0] = 0;
+	}
+	if (end == n && window.y1 < height_)
+	{
+		d[(n - 1) * lanes] -= c[(n - 1) * lanes] * solution_[x + size_t(window.y1) * width_];
+		c[(n - 1) * lanes] = 0;
+	}
 }
 
-void CRWCRSolver::calculateWeight()
+SeedSpan CRWCRSolver::batchSeedSpan(int batch, bool rows) const
 {
-	const float beta = 80, epsilon = 1e-5;
+	const int lanes = BatchTDMA::numLanes;
+	const int numLines = rows ? height_ : width_;
 
-	memset(wx_, 0, numPixels_ * sizeof(float));
-	for (int y = 0; y < height_; y++)
+	SeedSpan span = {rows ? width_ : height_, 0};
+	for (int line = batch * lanes; line < std::min((batch + 1) * lanes, numLines); line++)
 	{
-		for (int x = 0; x < width_ - 1; x++)
-		{
-			int index = y * width_ + x;
-			wx_[index] = (fabs((image_[index] - image_[index + 1])));
-		}
+		const SeedSpan& lineSpan = rows ? grown_.getRowSpan(line) : grown_.getColumnSpan(line);
+		span.begin = std::min(span.begin, lineSpan.begin);
+		span.end = std::max(span.end, lineSpan.end);
 	}
+	return span;
+}
 
-	normalize(wx_, numPixels_);
+void CRWCRSolver::assembleRowRhs(int batch, const float* u_n, unsigned char label, float* d, int stride)
+{
+	const int lanes = BatchTDMA::numLanes;
+	const SeedSpan seeds = batchSeedSpan(batch, true);
 
-	for (size_t i = 0; i < numPixels_; i++)
+	Kernels::get().rowRhs(u_n, wy_, labels_, label, seeds.begin, seeds.end, parameters_.lambda2D, dt_,
+	                      batch * lanes, std::min(lanes, height_ - batch * lanes), width_, height_, d, stride);
+}
+
+void CRWCRSolver::assembleColumnRhs(int batch, const float* u_n, unsigned char label, float* d, int stride)
+{
+	const int lanes = BatchTDMA::numLanes;
+	const SeedSpan seeds = batchSeedSpan(batch, false);
+
+	Kernels::get().columnRhs(u_n, wx_, labels_, label, seeds.begin, seeds.end, parameters_.lambda2D, dt_,
+	                         batch * lanes, std::min(lanes, width_ - batch * lanes), width_, height_, d, stride);
+}
+
+float CRWCRSolver::sweepColumnBatch(int batch, const float* upper, const float* pivot, const float* u_n, float* d)
+{
+	const int lanes = BatchTDMA::numLanes;
+	const int x0 = batch * lanes;
+	const int columns = std::min(lanes, width_ - x0);
+	const SeedSpan seeds = batchSeedSpan(batch, false);
+	const Kernels::Set& kernels = Kernels::get();
+
+	for (int y0 = 0; y0 < height_; y0 += columnTileRows)
 	{
-		wx_[i] = exp(-beta * wx_[i]) + epsilon;
+		const int rows = std::min(columnTileRows, height_ - y0);
+		const size_t row = size_t(y0) * width_;
+
+		// the rows of the tile are independent, so the kernel sees the tile as an image of its own
+		kernels.columnRhs(u_n + row, wx_ + row, labels_ + row, 1, seeds.begin - y0, seeds.end - y0,
+		                  parameters_.lambda2D, dt_, x0, columns, width_, rows, d + size_t(y0) * lanes, lanes);
+
+		// eliminate while the tile is still in cache
+		BatchTDMA::forwardSubstitute(wy_ + size_t(x0) * height_, height_, columns, pivot, d, y0, y0 + rows);
 	}
 
-	memset(wy_, 0, numPixels_ * sizeof(float));
-	for (int x = 0; x < width_; x++)
+	float delta = 0;
+	for (int y1 = height_; y1 > 0; y1 -= columnTileRows)
 	{
-		for (int y = 0; y < height_ - 1; y++)
+		const int y0 = std::max(0, y1 - columnTileRows);
+		BatchTDMA::backwardSubstitute(upper, d, y0, y1, height_);
+
+		for (int y = y0; y < y1; y++)
 		{
-			wy_[x * height_ + y] = fabs((image_[y * width_ + x] - image_[(y + 1) * width_ + x]));
+			const size_t row = x0 + size_t(y) * width_;
+			for (int l = 0; l < columns; l++)
+			{
+				delta = std::max(delta, std::fabs(d[y * lanes + l] - solution_[row + l]));
+				solution_[row + l] = d[y * lanes + l];
+			}
 		}
 	}
 
-	normalize(wy_, numPixels_);
-	for (size_t i = 0; i < numPixels_; i++)
+	return delta;
+}
+
+void CRWCRSolver::clearLane(float* a, float* b, float* c, float* d, int numRow)
+{
+	const int lanes = BatchTDMA::numLanes;
+
+	for (int r = 0; r < numRow; r++)
 	{
-		wy_[i] = exp(-beta * wy_[i]) + epsilon;
+		a[r * lanes] = 0;
+		b[r * lanes] = 1;
+		c[r * lanes] = 0;
+		if (d) d[r * lanes] = 0;
 	}
 }
 
-void CRWCRSolver::calculateGradient()
+void CRWCRSolver::calculateWeightAndGradient(const WeightBounds* bounds)
 {
-	memset(grad_, 0, numPixels_ * sizeof(float));
+	const float epsilon = 1e-5f;
+	const int tileSize = 64;
+	const int numTileRows = (height_ + tileSize - 1) / tileSize;
 
-	for (size_t x = 1; x < width_ - 1; x++)
+	// bounds of the raw wx, wy and grad for the normalization, l starting at 1 and u at 0
+	float lower[3] = {1, 1, 1}, upper[3] = {0, 0, 0};
+
+	PROFILE_START(differences);
+
+	// one pass over the image in tiles. wy_ is column-major, so the vertical differences of a
+	// tile are transposed through a small buffer instead of being written with a stride.
+#pragma omp parallel num_threads(numThreads())
 	{
-		for (size_t y = 1; y < height_ - 1; y++)
+		float l[3] = {1, 1, 1}, u[3] = {0, 0, 0};
+		float* dy = new float[tileSize * tileSize];
+
+#pragma omp for schedule(static)
+		for (int tile = 0; tile < numTileRows; tile++)
 		{
-			float gx = image_[x - 1 + y * width_] - image_[x + 1 + y * width_];
-			float gy = image_[x + (y - 1) * width_] - image_[x + (y + 1) * width_];
+			const int y0 = tile * tileSize, y1 = std::min(y0 + tileSize, height_);
+
+			for (int x0 = 0; x0 < width_; x0 += tileSize)
+			{
+				const int x1 = std::min(x0 + tileSize, width_);
+				const int innerX0 = std::max(x0, 1), innerX1 = std::min(x1, width_ - 1);
+
+				for (int y = y0; y < y1; y++)
+				{
+					const float* row = image_ + size_t(y) * width_;
+					// the differences past the last row and the gradient of the border rows are 0
+					const float* above = y > 0 ? row - width_ : row;
+					const float* below = y < height_ - 1 ? row + width_ : row;
+					const float inner = y > 0 && y < height_ - 1 ? 1.f : 0.f;
+					WeightType* wx = wx_ + size_t(y) * width_;
+					WeightType* grad = grad_ + size_t(y) * width_;
+					float* d = dy + (y - y0) * tileSize - x0;
+
+					for (int x = x0; x < std::min(x1, width_ - 1); x++)
+					{
+						const float v = std::fabs(row[x] - row[x + 1]);
+						wx[x] = WeightType(v);
+						l[0] = std::min(l[0], v);
+						u[0] = std::max(u[0], v);
+					}
+
+					for (int x = x0; x < x1; x++)
+					{
+						d[x] = std::fabs(row[x] - below[x]);
+						l[1] = std::min(l[1], d[x]);
+						u[1] = std::max(u[1], d[x]);
+					}
+
+					for (int x = innerX0; x < innerX1; x++)
+					{
+						const float v = inner * (std::fabs(row[x - 1] - row[x + 1]) + std::fabs(above[x] - below[x]));
+						grad[x] = WeightType(v);
+						l[2] = std::min(l[2], v);
+						u[2] = std::max(u[2], v);
+					}
+
+					// the last column has no right neighbour and the border columns no gradient
+					if (x1 == width_)
+					{
+						wx[width_ - 1] = WeightType(0.f);
+						grad[width_ - 1] = WeightType(0.f);
+						l[0] = l[2] = 0;
+					}
+					if (x0 == 0)
+					{
+						grad[0] = WeightType(0.f);
+						l[2] = 0;
+					}
+				}
+
+				for (int x = x0; x < x1; x++)
+				{
+					const float* d = dy + x - x0;
+					WeightType* wy = wy_ + size_t(x) * height_;
+					for (int y = y0; y < y1; y++)
+					{
+						wy[y] = WeightType(d[(y - y0) * tileSize]);
+					}
+				}
+			}
+		}
 
-			grad_[x + y * width_] = fabs(gx) + fabs(gy);
+#pragma omp critical
+		for (int i = 0; i < 3; i++)
+		{
+			lower[i] = std::min(lower[i], l[i]);
+			upper[i] = std::max(upper[i], u[i]);
 		}
+
+		delete[] dy;
+	}
+
+	PROFILE_RECORD("weight and gradient differences", differences);
+
+	if (bounds != nullptr)
+	{
+		std::copy(bounds->lower, bounds->lower + 3, lower);
+		std::copy(bounds->upper, bounds->upper + 3, upper);
+	}
+
+	PROFILE_START(mapping);
+	// map to [0, 1], unless all values are equal
+	float offset[3], scale[3];
+	for (int i = 0; i < 3; i++)
+	{
+		const bool flat = std::fabs(lower[i] - upper[i]) < 1e-6f;
+		offset[i] = flat ? 0 : lower[i];
+		scale[i] = flat ? 1 : 1 / (upper[i] - lower[i]);
+	}
+
+	const Kernels::Set& kernels = Kernels::get();
+
+#pragma omp parallel for num_threads(numThreads())
+	for (int y = 0; y < height_; y++)
+	{
+		// the three arrays have the same size, so any row-sized block of them can be mapped together
+		const size_t begin = size_t(y) * width_;
+		kernels.mapWeights(wx_ + begin, wy_ + begin, grad_ + begin, width_, offset, scale, parameters_.beta, epsilon);
 	}
-	normalize(grad_, numPixels_);
+
+	PROFILE_RECORD("weight and gradient normalization", mapping);
 }
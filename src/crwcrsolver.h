@@ -2,8 +2,21 @@
 #define CRWCRSOLVER_H
 
 #include<string>
+#include <atomic>
+#include <functional>
 #include "singleton.h"
-#include"twolabelseed.h"
+#include "seedbuffer.h"
+#include "weighttype.h"
+
+
+/**
+ * \brief range of the raw edge differences and gradients of an image, which the solver maps to [0, 1]
+ */
+struct WeightBounds
+{
+	// of wx, wy and grad
+	float lower[3], upper[3];
+};
 
 
 /**
@@ -12,45 +25,384 @@
 class CRWCRSolver
 {
 public:
-	CRWCRSolver(const float* image, int width, int height);
+	/**
+	 * \param image :normalized gray values, read in place while the solver lives
+	 * \param width 
+	 * \param height 
+	 * \param probability :caller buffer of width * height the solve writes the probability map to,
+	 * nullptr lets the solver own it
+	 * \param bounds :normalize the weights with these instead of the range of image, e.g. with
+	 * those of the whole image a tile is cut from, see weightBounds
+	 */
+	CRWCRSolver(const float* image, int width, int height, float* probability = nullptr,
+	            const WeightBounds* bounds = nullptr);
 	~CRWCRSolver();
 
-	void setSeed(TwoLabelSeed* seed);
+	CRWCRSolver(const CRWCRSolver&) = delete;
+	CRWCRSolver& operator=(const CRWCRSolver&) = delete;
+
+	/**
+	 * \brief seeds of the next solve, 1: foreground, 2: background. The solve only reads them, the
+	 * foreground grown by the 1D initialization is kept in a copy of the solver.
+	 * \param seed 
+	 */
+	void setSeed(SeedBuffer* seed);
+
+	/**
+	 * \brief range of the raw weights of an image as the constructor finds it, in one pass over
+	 * the rows without storing the weights
+	 * \param numThreads :0 for all
+	 */
+	static WeightBounds weightBounds(const float* image, int width, int height, int numThreads);
+
+	/**
+	 * \brief parameters of the following solves, otherwise those of Singleton<Parameters> at
+	 * construction. The edge weights keep the beta they were computed with.
+	 * \param parameters 
+	 */
+	void setParameters(const Parameters& parameters);
 
 	void solve();
 
+	/**
+	 * \brief re-solve after strokes were added to the seeds of the last solve. In the window around
+	 * the new seed pixels the grown foreground is reset to the seeds and grown again, and the window
+	 * is solved again from its seed mask, with the probabilities outside the window held fixed.
+	 * \param region :bounding box of the new seed pixels, see TwoLabelSeed::update
+	 */
+	void solveIncremental(const SeedRegion& region);
+
 	float* generateProbabilityImage() const;
 
+	/**
+	 * \brief the probability map in 16-bit fixed point, 65535 is probability 1.
+	 * The buffer is owned by the solver and refreshed on every call.
+	 */
+	unsigned short* generateProbabilityImage16();
+
+	/**
+	 * \brief segment into the labels of seeds at once. Every label solves the same systems with
+	 * its own right vector, so the line factorization is shared and the labels are substituted
+	 * together.
+	 * \param seeds :0: none, 1 to numLabels: label
+	 * \param numLabels 
+	 */
+	void solveMultiLabel(SeedBuffer* seeds, int numLabels);
+
+	/**
+	 * \brief probability map of one label of the last multi-label solve
+	 * \param label :1 to the number of labels
+	 */
+	const float* getLabelProbability(int label) const;
+
+	/**
+	 * \brief label of the largest probability of every pixel after a multi-label solve.
+	 * The buffer is owned by the solver and refreshed on every call.
+	 */
+	unsigned char* generateLabelImage();
+
+	/**
+	 * \brief called with the iterations done and the total after every 1D and PR iteration of the
+	 * full resolution level, from a thread of the solve. PR may converge before the total.
+	 * \param callback 
+	 */
+	void setProgressCallback(const std::function<void(int, int)>& callback);
+
+	/**
+	 * \brief called with the probability map of the full resolution level once the 1D initialization
+	 * is done and after every PR iteration, from a thread of the solve while the other threads wait.
+	 * The map is only valid during the call. An empty callback publishes nothing.
+	 * \param callback 
+	 */
+	void setIntermediateCallback(const std::function<void(const float*)>& callback);
+
+	/**
+	 * \brief stop the running solve once its current iteration is swept, callable from any thread.
+	 * The probability map of a cancelled solve is incomplete.
+	 */
+	void cancel();
+
+	/**
+	 * \brief whether the last solve was stopped by cancel
+	 */
+	bool isCancelled() const;
+
 	float getUseTime() const;
 
+	/**
+	 * \brief number of PR iterations run by the last solve
+	 */
+	int getIterations() const;
+
+	/**
+	 * \brief max-norm change of the probability map in the last PR iteration
+	 */
+	float getResidual() const;
+
 private:
 
-	void initialization();
+	/**
+	 * \brief the next coarser pyramid level of fine, whose edge weights and gradient are restricted
+	 * from those of fine
+	 * \param fine 
+	 * \param seeds :the grown seeds of fine, downsampled
+	 */
+	CRWCRSolver(const CRWCRSolver& fine, SeedBuffer* seeds);
+
+	/**
+	 * \brief coarse-to-fine PR after the 1D initialization, each level warm starts the PR of the
+	 * next finer one
+	 * \param levels :number of pyramid levels including this one
+	 */
+	void solveLevel(int levels);
+
+	/**
+	 * \brief copy the seeds into the labels grown by the solve
+	 */
+	void copySeeds();
+
+	/**
+	 * \brief 1D initialization growing the foreground of labels_ inside window. The lines crossing
+	 * the window are solved over their full length, so foreground outside it grows in as well.
+	 * \param window 
+	 */
+	void initialization(const SeedRegion& window);
+
+	/**
+	 * \brief 1D initialization growing the seeds of all labels, one right vector per label
+	 * \param numLabels 
+	 */
+	void initializationMultiLabel(int numLabels);
+
+	/**
+	 * \brief 2D PR iterations
+	 * \param maxIterations 
+	 * \param warmStart :start from the current solution_ instead of the seed mask
+	 */
+	void prcorrection(int maxIterations, bool warmStart);
+
+	/**
+	 * \brief PR iterations restricted to window from its seed mask, whose border takes solution_
+	 * outside as fixed values
+	 * \param window 
+	 * \param maxIterations 
+	 */
+	void prwindow(const SeedRegion& window, int maxIterations);
 
-	void prcorrection();
+	/**
+	 * \brief 2D PR iterations of all labels from their seed masks, results in labelSolution_
+	 * \param numLabels 
+	 * \param maxIterations 
+	 */
+	void prcorrectionMultiLabel(int numLabels, int maxIterations);
 
-	void TDMA(double* a, double* b, double* c, double* d, double* x, int numRow);
+	bool cancelRequested() const;
 
-	void normalize(float* data, size_t length);
+	/**
+	 * \brief pass done iterations of the running stage to the progress callback
+	 */
+	void reportProgress(int done) const;
 
-	void calculateWeight();
+	/**
+	 * \brief pass solution_ to the intermediate callback
+	 */
+	void publishIntermediate() const;
 
-	void calculateGradient();
+	/**
+	 * \brief number of threads used by the PR sweeps
+	 */
+	int numThreads() const;
 
-	Parameters& parameters_;
+	/**
+	 * \brief chunks every line of a sweep is split into. Lines are only split when there are fewer
+	 * batches than threads, as in small windows or late 1D iterations, and then into chunks of at
+	 * least minChunkRows nodes.
+	 * \param numBatches 
+	 * \param numRow :nodes per line
+	 */
+	int lineChunks(int numBatches, int numRow) const;
 
-	TwoLabelSeed* seeds_;
+	/**
+	 * \brief build the nodes [begin, end) of the 1D initialization system of one line into an interleaved batch
+	 * \param w :edge weights along the line
+	 * \param start :pixel index of the first node
+	 * \param stride :pixel index step between nodes
+	 * \param numRow 
+	 * \param begin 
+	 * \param end 
+	 * \param a :lower, at node 0 of the line
+	 * \param b :central
+	 * \param c :upper
+	 * \param d :right vector
+	 */
+	void assemble1DLine(const WeightType* w, size_t start, size_t stride, int numRow, int begin, int end, float* a,
+	                    float* b, float* c, float* d);
+
+	/**
+	 * \brief build the PR system matrix of the nodes [begin, end) of one line into an interleaved batch
+	 */
+	void assemblePRLine(const WeightType* w, size_t start, size_t stride, int numRow, int begin, int end, float* a,
+	                    float* b, float* c);
+
+	/**
+	 * \brief build the nodes [begin, end) of the PR row system of one window row into an interleaved
+	 * batch, the nodes left and right of the window move to the right vector
+	 * \param begin :first node, 0 is the left window border
+	 * \param end 
+	 * \param a :lower, at node 0 of the row
+	 */
+	void assembleWindowRow(const SeedRegion& window, int y, int begin, int end, float* a, float* b, float* c,
+	                       float* d);
+
+	/**
+	 * \brief build the nodes [begin, end) of the PR column system of one window column into an interleaved batch
+	 * \param half :row half step inside the window, row by row
+	 */
+	void assembleWindowColumn(const SeedRegion& window, int x, const float* half, int begin, int end, float* a,
+	                          float* b, float* c, float* d);
+
+	/**
+	 * \brief union of the seed spans of the lines of one batch, no seed lookups are needed outside
+	 * \param batch 
+	 * \param rows :row batch, otherwise column batch
+	 */
+	SeedSpan batchSeedSpan(int batch, bool rows) const;
+
+	/**
+	 * \brief build the interleaved PR right vectors of one batch of rows
+	 * \param batch 
+	 * \param u_n :solution of the previous half step
+	 * \param label :seed label whose pixels are pulled towards 1
+	 * \param d 
+	 * \param stride :distance between the nodes of a lane in d
+	 */
+	void assembleRowRhs(int batch, const float* u_n, unsigned char label, float* d, int stride);
+
+	/**
+	 * \brief build the interleaved PR right vectors of one batch of columns, see assembleRowRhs
+	 */
+	void assembleColumnRhs(int batch, const float* u_n, unsigned char label, float* d, int stride);
+
+	/**
+	 * \brief all row factors once per solve, shared out among the threads of the enclosing
+	 * parallel region. Does nothing in the compact build.
+	 * \param a :scratch of max(width_, height_) * numLanes
+	 * \param b :scratch of max(width_, height_) * numLanes
+	 * \param c :scratch of max(width_, height_) * numLanes
+	 */
+	void factorLines(float* a, float* b, float* c);
+
+	/**
+	 * \brief the factors of one batch of rows, cached or, in the compact build, factored into scratch.
+	 * The lower diagonal is not kept, the substitution reads it from the weights.
+	 * \param scratch :3 * width_ * numLanes
+	 */
+	void rowFactors(int batch, float* scratch, float* b, float* c, const float*& upper, const float*& pivot);
+
+	/**
+	 * \brief the factors of one batch of columns, see rowFactors
+	 */
+	void columnFactors(int batch, float* scratch, float* b, float* c, const float*& upper, const float*& pivot);
+
+	/**
+	 * \brief assemble and LU factor the PR systems of one batch of rows
+	 * \param batch 
+	 * \param lower :scratch, the lower diagonal assembled for the factorization
+	 * \param upper 
+	 * \param pivot 
+	 * \param b :scratch of width_ * numLanes
+	 * \param c :scratch of width_ * numLanes
+	 */
+	void factorRowBatch(int batch, float* lower, float* upper, float* pivot, float* b, float* c);
+
+	/**
+	 * \brief assemble and LU factor the PR systems of one batch of columns
+	 */
+	void factorColumnBatch(int batch, float* lower, float* upper, float* pivot, float* b, float* c);
+
+	/**
+	 * \brief PR sweep of one batch of columns. The right vectors are built tile by tile of rows
+	 * and eliminated while the tile is in cache.
+	 * \param batch 
+	 * \param upper :factors of the batch
+	 * \param pivot 
+	 * \param u_n :solution of the row half step, the result goes to solution_
+	 * \param d :interleaved scratch of height_ * numLanes
+	 * \return max-norm change of the batch
+	 */
+	float sweepColumnBatch(int batch, const float* upper, const float* pivot, const float* u_n, float* d);
+
+	/**
+	 * \brief fill an unused lane of a batch with an identity system
+	 */
+	void clearLane(float* a, float* b, float* c, float* d, int numRow);
+
+	/**
+	 * \brief edge weights wx_, wy_ and the normalized gradient grad_ in one pass over the image
+	 * \param bounds :normalization, nullptr for the range of the image
+	 */
+	void calculateWeightAndGradient(const WeightBounds* bounds);
+
+	// rows per tile of the column sweep
+	static const int columnTileRows = 64;
+
+	// shortest chunk of a split line, shorter ones cost more in the border solve than they save
+	static const int minChunkRows = 1024;
+
+	// a copy, so that the parameters cannot change during a solve
+	Parameters parameters_;
+
+	// the caller's seeds, only read
+	SeedBuffer* seeds_;
+
+	// the seeds plus the foreground grown by the 1D initialization, kept for the incremental solve
+	SeedBuffer grown_;
+
+	// labels of grown_, 0: none, otherwise the label
+	unsigned char* labels_;
 
 	const float* image_;
 	int width_, height_;
 	size_t numPixels_;
 
 	// weight
-	float *wx_, *wy_;
+	WeightType *wx_, *wy_;
+
+	WeightType* grad_;
+
+	// LU factors of the row and column systems, interleaved in batches of BatchTDMA::numLanes lines.
+	// The lower factor is -w and is read from wx_ and wy_. The compact build factors each batch when
+	// it is swept instead.
+	int numRowBatches_, numColBatches_;
+#ifndef CRWCR_COMPACT_MEMORY
+	float *rowUpper_, *rowPivot_;
+	float *colUpper_, *colPivot_;
+#endif
 
-	float* grad_;
 	float* solution_;
-	int time_;
+	// false if solution_ is the caller's buffer
+	bool ownsSolution_;
+	// milliseconds of the last solve
+	float time_;
+	int iterations_;
+	float residual_;
+	// time step of the running PR
+	float dt_;
+
+	unsigned short* probability16_;
+
+	std::function<void(int, int)> progress_;
+	std::function<void(const float*)> intermediate_;
+	std::atomic<bool> cancelled_;
+	// the flag the solve polls, cancelled_ of the full resolution solver on the coarse levels
+	const std::atomic<bool>* cancelRequest_;
+	// iterations of the earlier stages and of the whole level, for reportProgress
+	int progressBase_, progressTotal_;
+
+	// multi-label results, one probability map per label
+	int numLabels_;
+	float* labelSolution_;
+	unsigned char* labelImage_;
 };
 
 #endif // !CRWCRSOLVER_H
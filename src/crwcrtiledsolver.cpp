@@ -0,0 +1,134 @@
+#include "crwcrtiledsolver.h"
+#include "crwcrsolver.h"
+#include "mappedfile.h"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+CRWCRTiledSolver::CRWCRTiledSolver(int width, int height) :
+	parameters_(Singleton<Parameters>::GetInstance()),
+	width_(width),
+	height_(height),
+	time_(0),
+	solvedTiles_(0)
+{
+}
+
+bool CRWCRTiledSolver::solve(const std::string& imagePath, const std::string& labelPath,
+                             const std::string& outputPath)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	const size_t numPixels = size_t(width_) * height_;
+
+	MappedFile image, labels, output;
+	if (!image.openRead(imagePath) || image.size() != numPixels * sizeof(float) ||
+		!labels.openRead(labelPath) || labels.size() != numPixels ||
+		!output.create(outputPath, numPixels * sizeof(float)))
+	{
+		return false;
+	}
+
+	const float* imageData = reinterpret_cast<const float*>(image.data());
+	const unsigned char* labelData = reinterpret_cast<const unsigned char*>(labels.data());
+	float* outputData = reinterpret_cast<float*>(output.data());
+
+	// the weights of every tile are normalized with the range of the whole image, as a solve of
+	// the whole image would. The pass reads the image once, its pages are dropped afterwards.
+	const WeightBounds bounds = CRWCRSolver::weightBounds(imageData, width_, height_, parameters_.numThreads);
+	image.release(0, numPixels * sizeof(float));
+
+	const int core = getTileSize();
+	const int halo = parameters_.tileHalo;
+	const int maxTile = core + 2 * halo;
+
+	// tile buffers are reused, the solver itself is rebuilt for every tile
+	float* tileImage = new float[size_t(maxTile) * maxTile];
+	unsigned char* tileLabels = new unsigned char[size_t(maxTile) * maxTile];
+
+	solvedTiles_ = 0;
+	for (int y0 = 0; y0 < height_; y0 += core)
+	{
+		const int y1 = std::min(y0 + core, height_);
+		const int haloY0 = std::max(y0 - halo, 0), haloY1 = std::min(y1 + halo, height_);
+
+		for (int x0 = 0; x0 < width_; x0 += core)
+		{
+			const int x1 = std::min(x0 + core, width_);
+			const int haloX0 = std::max(x0 - halo, 0), haloX1 = std::min(x1 + halo, width_);
+			const int tw = haloX1 - haloX0, th = haloY1 - haloY0;
+
+			bool hasForeground = false;
+			for (int y = haloY0; y < haloY1; y++)
+			{
+				const size_t row = size_t(y) * width_ + haloX0;
+				const size_t tileRow = size_t(y - haloY0) * tw;
+				memcpy(tileImage + tileRow, imageData + row, tw * sizeof(float));
+				memcpy(tileLabels + tileRow, labelData + row, tw);
+				hasForeground = hasForeground || std::find(labelData + row, labelData + row + tw, 1) != labelData + row + tw;
+			}
+
+			// without foreground seeds the probability stays 0, no need to run the solver
+			if (!hasForeground)
+			{
+				for (int y = y0; y < y1; y++)
+				{
+					std::fill(outputData + size_t(y) * width_ + x0, outputData + size_t(y) * width_ + x1, 0.f);
+				}
+				continue;
+			}
+
+			{
+				SeedBuffer seeds(tileLabels, tw, th);
+
+				CRWCRSolver solver(tileImage, tw, th, nullptr, &bounds);
+				solver.setParameters(parameters_);
+				solver.setSeed(&seeds);
+				solver.solve();
+
+				const float* probability = solver.generateProbabilityImage();
+				for (int y = y0; y < y1; y++)
+				{
+					memcpy(outputData + size_t(y) * width_ + x0,
+					       probability + size_t(y - haloY0) * tw + (x0 - haloX0), (x1 - x0) * sizeof(float));
+				}
+			}
+			solvedTiles_++;
+		}
+
+		// rows above the next band's halo are not read again, and this band's output is complete
+		const size_t doneRows = size_t(std::max(y1 - halo, 0));
+		image.release(0, doneRows * width_ * sizeof(float));
+		labels.release(0, doneRows * width_);
+		output.release(0, size_t(y1) * width_ * sizeof(float));
+	}
+
+	delete[] tileImage;
+	delete[] tileLabels;
+
+	std::chrono::duration<float, std::milli> diff = std::chrono::steady_clock::now() - start;
+	time_ = diff.count();
+
+	return true;
+}
+
+float CRWCRTiledSolver::getUseTime() const
+{
+	return time_;
+}
+
+int CRWCRTiledSolver::getTileSize() const
+{
+	// the largest square tile, halo included, whose solver fits into the budget
+	const double budget = double(parameters_.tileMemoryMB) * 1024 * 1024;
+	const int side = int(std::sqrt(budget / bytesPerPixel));
+	const int minTileSize = 64;
+
+	return std::max(side - 2 * parameters_.tileHalo, minTileSize);
+}
+
+int CRWCRTiledSolver::getSolvedTiles() const
+{
+	return solvedTiles_;
+}
@@ -0,0 +1,63 @@
+#ifndef CRWCRTILEDSOLVER_H
+#define CRWCRTILEDSOLVER_H
+
+#include <string>
+#include "singleton.h"
+
+
+/**
+ * \brief Solve images larger than the memory tile by tile. The image, the seed labels and the
+ * probability map are raw row-major files, memory-mapped and streamed through CRWCRSolver one
+ * tile at a time. Each tile is solved with a halo of its neighbours' pixels so that the cut
+ * does not show in the result.
+ *
+ * File formats: image float32, labels uint8 with 0: none, 1: foreground, 2: background,
+ * probability map float32, all width * height values without header.
+ */
+class CRWCRTiledSolver
+{
+public:
+	CRWCRTiledSolver(int width, int height);
+
+	/**
+	 * \brief solve the mapped image tile by tile
+	 * \param imagePath 
+	 * \param labelPath 
+	 * \param outputPath :created, or replaced if it exists
+	 * \return false if a file cannot be mapped or has the wrong size
+	 */
+	bool solve(const std::string& imagePath, const std::string& labelPath, const std::string& outputPath);
+
+	float getUseTime() const;
+
+	/**
+	 * \brief width and height of the tile cores, derived from Parameters::tileMemoryMB
+	 */
+	int getTileSize() const;
+
+	/**
+	 * \brief number of tiles the last solve ran the solver on, tiles without foreground are skipped
+	 */
+	int getSolvedTiles() const;
+
+	/**
+	 * \brief estimated memory per pixel of a tile including its halo: the tile copies, the seed
+	 * buffer, the solver arrays and line factors, and a third more for the coarser pyramid levels
+	 */
+#ifdef CRWCR_COMPACT_MEMORY
+	static const size_t bytesPerPixel = 30;
+#else
+	static const size_t bytesPerPixel = 58;
+#endif
+
+private:
+	// a copy, so that the parameters cannot change during a solve
+	Parameters parameters_;
+
+	int width_, height_;
+	// milliseconds of the last solve
+	float time_;
+	int solvedTiles_;
+};
+
+#endif // CRWCRTILEDSOLVER_H
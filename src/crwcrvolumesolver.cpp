@@ -0,0 +1,647 @@
+#include "crwcrvolumesolver.h"
+#include "batchtdma.h"
+#include "fastmath.h"
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace
+{
+	/**
+	 * \brief raw differences to the next voxel along x, y and z and the raw gradient of every voxel
+	 * of row (y, z), passed to f(x, raw). The differences past the last voxel along a direction
+	 * are 0, as is the gradient on the border.
+	 */
+	template <typename F>
+	void forEachRawDifference(const float* volume, int width, int height, int depth, int y, int z, F f)
+	{
+		const size_t sliceSize = size_t(width) * height;
+		const float* row = volume + size_t(y) * width + z * sliceSize;
+		const float* below = y < height - 1 ? row + width : row;
+		const float* above = y > 0 ? row - width : row;
+		const float* next = z < depth - 1 ? row + sliceSize : row;
+		const float* previous = z > 0 ? row - sliceSize : row;
+		const bool inner = y > 0 && y < height - 1 && z > 0 && z < depth - 1;
+
+		for (int x = 0; x < width; x++)
+		{
+			const float raw[4] = {
+				x < width - 1 ? std::fabs(row[x] - row[x + 1]) : 0.f,
+				std::fabs(row[x] - below[x]),
+				std::fabs(row[x] - next[x]),
+				inner && x > 0 && x < width - 1
+					? std::fabs(row[x - 1] - row[x + 1]) + std::fabs(above[x] - below[x]) +
+					std::fabs(previous[x] - next[x])
+					: 0.f
+			};
+			f(x, raw);
+		}
+	}
+
+	/**
+	 * \brief line along a direction through a voxel, numbered as the voxels with coordinate 0 along it
+	 * \param index
+	 * \param stride :of the direction
+	 * \param size :of the volume along the direction
+	 */
+	inline size_t lineOf(size_t index, size_t stride, int size)
+	{
+		return index % stride + index / (stride * size) * stride;
+	}
+
+	/**
+	 * \brief first voxel of a line numbered by lineOf
+	 */
+	inline size_t lineStart(size_t line, size_t stride, int size)
+	{
+		return line % stride + line / stride * stride * size;
+	}
+}
+
+CRWCRVolumeSolver::CRWCRVolumeSolver(const float* volume, int width, int height, int depth,
+                                     const VolumeWeightBounds* bounds) :
+	parameters_(Singleton<Parameters>::GetInstance()),
+	seeds_(nullptr),
+	volume_(volume),
+	time_(0),
+	iterations_(0),
+	residual_(0)
+{
+	dims_[0] = width;
+	dims_[1] = height;
+	dims_[2] = depth;
+	strides_[0] = 1;
+	strides_[1] = size_t(width);
+	strides_[2] = size_t(width) * height;
+	numVoxels_ = strides_[2] * depth;
+
+	for (int dir = 0; dir < 3; dir++)
+	{
+		weights_[dir] = new WeightType[numVoxels_];
+	}
+	grad_ = new WeightType[numVoxels_];
+	solution_ = new float[numVoxels_];
+	buffer_ = new float[numVoxels_];
+	labels_ = new unsigned char[numVoxels_];
+
+	calculateWeightAndGradient(bounds);
+}
+
+CRWCRVolumeSolver::~CRWCRVolumeSolver()
+{
+	for (int dir = 0; dir < 3; dir++)
+	{
+		delete[] weights_[dir];
+	}
+	delete[] grad_;
+	delete[] solution_;
+	delete[] buffer_;
+	delete[] labels_;
+}
+
+VolumeWeightBounds CRWCRVolumeSolver::weightBounds(const float* volume, int width, int height, int depth,
+                                                   int numThreads)
+{
+#ifdef _OPENMP
+	if (numThreads <= 0)
+	{
+		numThreads = omp_get_max_threads();
+	}
+#endif
+
+	// l starting at 1 and u at 0 as in calculateWeightAndGradient
+	VolumeWeightBounds bounds = {{1, 1, 1, 1}, {0, 0, 0, 0}};
+
+#pragma omp parallel num_threads(numThreads)
+	{
+		float l[4] = {1, 1, 1, 1}, u[4] = {0, 0, 0, 0};
+
+#pragma omp for schedule(static)
+		for (int z = 0; z < depth; z++)
+		{
+			for (int y = 0; y < height; y++)
+			{
+				forEachRawDifference(volume, width, height, depth, y, z, [&](int, const float* raw)
+				{
+					for (int i = 0; i < 4; i++)
+					{
+						l[i] = std::min(l[i], raw[i]);
+						u[i] = std::max(u[i], raw[i]);
+					}
+				});
+			}
+		}
+
+#pragma omp critical
+		for (int i = 0; i < 4; i++)
+		{
+			bounds.lower[i] = std::min(bounds.lower[i], l[i]);
+			bounds.upper[i] = std::max(bounds.upper[i], u[i]);
+		}
+	}
+
+	return bounds;
+}
+
+void CRWCRVolumeSolver::setParameters(const Parameters& parameters)
+{
+	parameters_ = parameters;
+}
+
+void CRWCRVolumeSolver::setSeed(const unsigned char* labels)
+{
+	seeds_ = labels;
+}
+
+void CRWCRVolumeSolver::solve()
+{
+	auto start = std::chrono::steady_clock::now();
+
+	// every solve grows from the seeds themselves, not from the foreground of the last solve
+	std::copy(seeds_, seeds_ + numVoxels_, labels_);
+
+	initialization();
+	prcorrection(parameters_.maxIterations2D);
+
+	std::chrono::duration<float, std::milli> diff = std::chrono::steady_clock::now() - start;
+	time_ = diff.count();
+}
+
+float* CRWCRVolumeSolver::generateProbabilityVolume() const
+{
+	return solution_;
+}
+
+float CRWCRVolumeSolver::getUseTime() const
+{
+	return time_;
+}
+
+int CRWCRVolumeSolver::getIterations() const
+{
+	return iterations_;
+}
+
+float CRWCRVolumeSolver::getResidual() const
+{
+	return residual_;
+}
+
+void CRWCRVolumeSolver::initialization()
+{
+	const int lanes = BatchTDMA::numLanes;
+	const int maxSize = std::max(dims_[0], std::max(dims_[1], dims_[2]));
+
+	// lines to solve along each direction, numbered by lineOf. Only the interior nodes of a
+	// line see the labels, so a voxel marks the lines it is an interior node of.
+	std::vector<unsigned char> dirty[3];
+	for (int dir = 0; dir < 3; dir++)
+	{
+		dirty[dir].assign(numVoxels_ / dims_[dir], 0);
+	}
+
+	auto markLines = [&](size_t index)
+	{
+		for (int dir = 0; dir < 3; dir++)
+		{
+			const int n = dims_[dir];
+			const size_t s = strides_[dir];
+			const int position = int(index / s % n);
+			if (position > 0 && position < n - 1)
+			{
+				unsigned char* mark = &dirty[dir][lineOf(index, s, n)];
+#pragma omp atomic write
+				*mark = 1;
+			}
+		}
+	};
+
+	// at first the lines through the foreground seeds
+#pragma omp parallel for num_threads(numThreads()) schedule(static)
+	for (int z = 0; z < dims_[2]; z++)
+	{
+		for (size_t index = z * strides_[2]; index < (z + 1) * strides_[2]; index++)
+		{
+			if (labels_[index] == 1)
+			{
+				markLines(index);
+			}
+		}
+	}
+
+	std::vector<size_t> lines;
+
+	for (int i = 0; i < parameters_.maxIterations1D; i++)
+	{
+		int solvedLines = 0;
+
+		for (int dir = 0; dir < 3; dir++)
+		{
+			const int n = dims_[dir];
+			const size_t s = strides_[dir];
+
+			lines.clear();
+			for (size_t j = 0; j < dirty[dir].size(); j++)
+			{
+				if (dirty[dir][j] != 0)
+				{
+					dirty[dir][j] = 0;
+					lines.push_back(lineStart(j, s, n));
+				}
+			}
+			solvedLines += int(lines.size());
+
+			// the lines along one direction are disjoint, so their batches can grow the seeds in
+			// parallel. The marks they set may be shared with other batches, hence atomic.
+			const int numLineBatches = int((lines.size() + lanes - 1) / lanes);
+#pragma omp parallel num_threads(numThreads())
+			{
+				float* a = new float[maxSize * lanes];
+				float* b = new float[maxSize * lanes];
+				float* c = new float[maxSize * lanes];
+				float* d = new float[maxSize * lanes];
+				float* solution = new float[maxSize * lanes];
+
+#pragma omp for schedule(dynamic)
+				for (int batch = 0; batch < numLineBatches; batch++)
+				{
+					const size_t first = size_t(batch) * lanes;
+					for (int l = 0; l < lanes; l++)
+					{
+						if (first + l < lines.size())
+						{
+							assemble1DLine(dir, lines[first + l], a + l, b + l, c + l, d + l);
+						}
+						else
+						{
+							for (int r = 0; r < n; r++)
+							{
+								a[r * lanes + l] = 0;
+								b[r * lanes + l] = 1;
+								c[r * lanes + l] = 0;
+								d[r * lanes + l] = 0;
+							}
+						}
+					}
+
+					BatchTDMA::solve(a, b, c, d, solution, n);
+
+					for (int l = 0; l < lanes && first + l < lines.size(); l++)
+					{
+						for (int r = 0; r < n; r++)
+						{
+							const size_t index = lines[first + l] + r * s;
+							if (solution[r * lanes + l] >= parameters_.foreThreshold && labels_[index] != 1)
+							{
+								labels_[index] = 1;
+								markLines(index);
+							}
+						}
+					}
+				}
+
+				delete[] a;
+				delete[] b;
+				delete[] c;
+				delete[] d;
+				delete[] solution;
+			}
+		}
+
+		// nothing grew in the last round
+		if (solvedLines == 0)
+		{
+			break;
+		}
+	}
+}
+
+void CRWCRVolumeSolver::prcorrection(int maxIterations)
+{
+	const int lanes = BatchTDMA::numLanes;
+	const int maxSize = std::max(dims_[0], std::max(dims_[1], dims_[2]));
+
+	for (size_t i = 0; i < numVoxels_; i++)
+	{
+		solution_[i] = labels_[i] == 1;
+	}
+
+	float* residuals = new float[std::max(maxIterations, 1)];
+	std::fill(residuals, residuals + std::max(maxIterations, 1), 0.f);
+
+	// the x and y sweeps work slice by slice, the z sweep on (x, y) lines across all slices
+#pragma omp parallel num_threads(numThreads())
+	{
+		float* scratch = new float[5 * maxSize * lanes];
+		int coords[3 * BatchTDMA::numLanes];
+
+		int iteration = 0;
+		while (iteration < maxIterations)
+		{
+			float delta = 0;
+
+			for (int dir = 0; dir < 3; dir++)
+			{
+				const int batches = numBatches(dir);
+
+#pragma omp for schedule(static)
+				for (int batch = 0; batch < batches; batch++)
+				{
+					const int numLines = batchLines(dir, batch, coords);
+					delta = std::max(delta, sweepBatch(dir, coords, numLines, scratch));
+				}
+
+				// every sweep reads the previous iterate only, so the batches need no order
+#pragma omp single
+				std::swap(solution_, buffer_);
+			}
+
+#pragma omp critical
+			residuals[iteration] = std::max(residuals[iteration], delta);
+
+#pragma omp barrier
+
+			if (residuals[iteration++] < parameters_.tolerance2D)
+			{
+				break;
+			}
+		}
+
+#pragma omp single
+		{
+			iterations_ = iteration;
+			residual_ = iteration > 0 ? residuals[iteration - 1] : 0;
+		}
+
+		delete[] scratch;
+	}
+
+	delete[] residuals;
+}
+
+int CRWCRVolumeSolver::numBatches(int dir) const
+{
+	const int lanes = BatchTDMA::numLanes;
+
+	switch (dir)
+	{
+	case 0:
+		return dims_[2] * ((dims_[1] + lanes - 1) / lanes);
+	case 1:
+		return dims_[2] * ((dims_[0] + lanes - 1) / lanes);
+	default:
+		return dims_[1] * ((dims_[0] + lanes - 1) / lanes);
+	}
+}
+
+int CRWCRVolumeSolver::batchLines(int dir, int batch, int* coords) const
+{
+	const int lanes = BatchTDMA::numLanes;
+
+	// the coordinate that is batched by 16 and the one fixed for the batch
+	const int batched = dir == 0 ? 1 : 0;
+	const int fixed = dir == 2 ? 1 : 2;
+	const int perLine = (dims_[batched] + lanes - 1) / lanes;
+	const int first = batch % perLine * lanes;
+	const int numLines = std::min(lanes, dims_[batched] - first);
+
+	for (int l = 0; l < numLines; l++)
+	{
+		int* p = coords + 3 * l;
+		p[dir] = 0;
+		p[batched] = first + l;
+		p[fixed] = batch / perLine;
+	}
+
+	return numLines;
+}
+
+float CRWCRVolumeSolver::sweepBatch(int dir, const int* coords, int numLines, float* scratch)
+{
+	const int lanes = BatchTDMA::numLanes;
+	const int n = dims_[dir];
+	const size_t s = strides_[dir];
+	const WeightType* w = weights_[dir];
+	const int other1 = (dir + 1) % 3, other2 = (dir + 2) % 3;
+
+	float* a = scratch;
+	float* b = a + n * lanes;
+	float* c = b + n * lanes;
+	float* d = c + n * lanes;
+	float* x = d + n * lanes;
+
+	size_t start[BatchTDMA::numLanes];
+	for (int l = 0; l < numLines; l++)
+	{
+		const int* p = coords + 3 * l;
+		start[l] = p[0] + p[1] * strides_[1] + p[2] * strides_[2];
+	}
+
+	// node by node, so that the lanes of y- and z-lines read neighbouring voxels
+	for (int r = 0; r < n; r++)
+	{
+		float* ar = a + r * lanes;
+		float* br = b + r * lanes;
+		float* cr = c + r * lanes;
+		float* dr = d + r * lanes;
+
+		for (int l = 0; l < numLines; l++)
+		{
+			const int* p = coords + 3 * l;
+			const size_t index = start[l] + r * s;
+
+			// the first and last node see a ghost neighbour with u = 0 and w = 1
+			const float wBefore = r > 0 ? toFloat(w[index - s]) : 1;
+			const float wAfter = r < n - 1 ? toFloat(w[index]) : 1;
+			ar[l] = r > 0 ? -wBefore : 0;
+			cr[l] = r < n - 1 ? -wAfter : 0;
+
+			// the edges across the line keep their full weight on the diagonal, their neighbours
+			// come from the previous iterate
+			float across = 0;
+			const float neighbours = coupling(solution_, index, p[other1], other1, across) +
+				coupling(solution_, index, p[other2], other2, across);
+
+			br[l] = wBefore + wAfter + across + parameters_.dt + parameters_.gamma2D * toFloat(grad_[index]) +
+				(labels_[index] != 0 ? parameters_.lambda2D : 0);
+			dr[l] = (labels_[index] == 1 ? parameters_.lambda2D : 0) + neighbours + solution_[index] * parameters_.dt;
+		}
+
+		for (int l = numLines; l < lanes; l++)
+		{
+			ar[l] = 0;
+			br[l] = 1;
+			cr[l] = 0;
+			dr[l] = 0;
+		}
+	}
+
+	BatchTDMA::solve(a, b, c, d, x, n);
+
+	float delta = 0;
+	for (int r = 0; r < n; r++)
+	{
+		for (int l = 0; l < numLines; l++)
+		{
+			const size_t index = start[l] + r * s;
+			const float value = x[r * lanes + l];
+			delta = std::max(delta, std::fabs(value - solution_[index]));
+			buffer_[index] = value;
+		}
+	}
+
+	return delta;
+}
+
+float CRWCRVolumeSolver::coupling(const float* u, size_t index, int position, int dir, float& weight) const
+{
+	const size_t s = strides_[dir];
+	const WeightType* w = weights_[dir];
+
+	float sum = 0;
+	if (position > 0)
+	{
+		const float before = toFloat(w[index - s]);
+		weight += before;
+		sum += before * u[index - s];
+	}
+	else
+	{
+		weight += 1;
+	}
+
+	if (position < dims_[dir] - 1)
+	{
+		const float after = toFloat(w[index]);
+		weight += after;
+		sum += after * u[index + s];
+	}
+	else
+	{
+		weight += 1;
+	}
+
+	return sum;
+}
+
+void CRWCRVolumeSolver::assemble1DLine(int dir, size_t start, float* a, float* b, float* c, float* d)
+{
+	const int lanes = BatchTDMA::numLanes;
+	const int n = dims_[dir];
+	const size_t s = strides_[dir];
+	const WeightType* w = weights_[dir];
+
+	for (int r = 1; r < n - 1; r++)
+	{
+		const size_t index = start + r * s;
+		const int k = r * lanes;
+		a[k] = -toFloat(w[index - s]);
+		c[k] = -toFloat(w[index]);
+		b[k] = -(a[k] + c[k]) + (labels_[index] != 0 ? parameters_.lambda1D : 0) +
+			parameters_.gamma1D * toFloat(grad_[index]);
+		d[k] = labels_[index] == 1 ? parameters_.lambda1D : 0.f;
+	}
+
+	a[0] = -1;
+	c[0] = -toFloat(w[start]);
+	b[0] = -(a[0] + c[0]);
+
+	const int last = (n - 1) * lanes;
+	a[last] = -toFloat(w[start + (n - 2) * s]);
+	c[last] = -1;
+	b[last] = -(a[last] + c[last]);
+
+	d[0] = d[last] = 0;
+}
+
+void CRWCRVolumeSolver::calculateWeightAndGradient(const VolumeWeightBounds* bounds)
+{
+	const float epsilon = 1e-5f;
+	const int width = dims_[0], height = dims_[1], depth = dims_[2];
+
+	// bounds of the raw wx, wy, wz and grad for the normalization
+	float lower[4] = {1, 1, 1, 1}, upper[4] = {0, 0, 0, 0};
+
+	// slice by slice, each slice only reads its two neighbours
+#pragma omp parallel num_threads(numThreads())
+	{
+		float l[4] = {1, 1, 1, 1}, u[4] = {0, 0, 0, 0};
+
+#pragma omp for schedule(static)
+		for (int z = 0; z < depth; z++)
+		{
+			for (int y = 0; y < height; y++)
+			{
+				const size_t begin = y * strides_[1] + z * strides_[2];
+				forEachRawDifference(volume_, width, height, depth, y, z, [&](int x, const float* raw)
+				{
+					for (int i = 0; i < 3; i++)
+					{
+						weights_[i][begin + x] = WeightType(raw[i]);
+					}
+					grad_[begin + x] = WeightType(raw[3]);
+
+					for (int i = 0; i < 4; i++)
+					{
+						l[i] = std::min(l[i], raw[i]);
+						u[i] = std::max(u[i], raw[i]);
+					}
+				});
+			}
+		}
+
+#pragma omp critical
+		for (int i = 0; i < 4; i++)
+		{
+			lower[i] = std::min(lower[i], l[i]);
+			upper[i] = std::max(upper[i], u[i]);
+		}
+	}
+
+	if (bounds != nullptr)
+	{
+		std::copy(bounds->lower, bounds->lower + 4, lower);
+		std::copy(bounds->upper, bounds->upper + 4, upper);
+	}
+
+	// map to [0, 1], unless all values are equal
+	float offset[4], scale[4];
+	for (int i = 0; i < 4; i++)
+	{
+		const bool flat = std::fabs(lower[i] - upper[i]) < 1e-6f;
+		offset[i] = flat ? 0 : lower[i];
+		scale[i] = flat ? 1 : 1 / (upper[i] - lower[i]);
+	}
+
+	const float beta = parameters_.beta;
+
+#pragma omp parallel for num_threads(numThreads())
+	for (int z = 0; z < depth; z++)
+	{
+		const size_t begin = z * strides_[2];
+		for (size_t i = begin; i < begin + strides_[2]; i++)
+		{
+			for (int dir = 0; dir < 3; dir++)
+			{
+				weights_[dir][i] = WeightType(expNeg(-beta * scale[dir] * (toFloat(weights_[dir][i]) - offset[dir])) +
+					epsilon);
+			}
+			grad_[i] = WeightType((toFloat(grad_[i]) - offset[3]) * scale[3]);
+		}
+	}
+}
+
+int CRWCRVolumeSolver::numThreads() const
+{
+#ifdef _OPENMP
+	return parameters_.numThreads > 0 ? parameters_.numThreads : omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
@@ -0,0 +1,177 @@
+#ifndef CRWCRVOLUMESOLVER_H
+#define CRWCRVOLUMESOLVER_H
+
+#include "singleton.h"
+#include "crwcrsolver.h"
+
+
+/**
+ * \brief range of the raw edge differences and gradients of a volume, which the solver maps to [0, 1]
+ */
+struct VolumeWeightBounds
+{
+	// of wx, wy, wz and grad
+	float lower[4], upper[4];
+};
+
+
+/**
+ * \brief CRWCR on a volume, e.g. a CT stack, solved as a whole instead of slice by slice.
+ * Each iteration sweeps along x, y and z, and the 1D initialization also grows the seeds along
+ * z-lines. The 2D parameters apply to the volume as well.
+ *
+ * With three directions the explicit half steps of the 2D PR iteration are unstable, so each
+ * sweep is a line relaxation instead: the lines along one direction are solved with the edges
+ * across them on the diagonal and their neighbours taken from the previous iterate. The system
+ * is an M-matrix, so the sweeps converge for every dt and keep the map in [0, 1].
+ *
+ * The price is convergence. A line relaxation damps smooth errors by a factor of about 1 - O(h^2)
+ * per iteration, an ADI iteration with a tuned dt by 1 - O(h). On a 64x64x48 sphere each
+ * iteration shrinks the change by only 3% once the 1D initialization has grown the object, and
+ * without the growth 200 iterations lift 82 of its 12533 voxels above 0.5. The result therefore
+ * rests on the 1D initialization, and maxIterations2D only smooths it.
+ *
+ * Voxel (x, y, z) is stored at x + y * width + z * width * height. Every dimension must be at
+ * least 2. Besides the volume and the seeds the solver keeps 4 weight arrays of WeightType,
+ * 2 float arrays and the grown labels per voxel, 25 bytes, or 17 in the compact build.
+ * CRWCRSlabSolver streams volumes larger than the memory through it slab by slab.
+ */
+class CRWCRVolumeSolver
+{
+public:
+	/**
+	 * \param volume :read while constructing only
+	 * \param width
+	 * \param height
+	 * \param depth
+	 * \param bounds :range used to normalize the weights, e.g. the one of the whole volume when this
+	 * is a slab of it, nullptr for the range of volume
+	 */
+	CRWCRVolumeSolver(const float* volume, int width, int height, int depth,
+	                  const VolumeWeightBounds* bounds = nullptr);
+	~CRWCRVolumeSolver();
+
+	CRWCRVolumeSolver(const CRWCRVolumeSolver&) = delete;
+	CRWCRVolumeSolver& operator=(const CRWCRVolumeSolver&) = delete;
+
+	/**
+	 * \brief raw edge differences and gradients of a volume, e.g. for the normalization of its slabs
+	 * \param numThreads :0 for all available cores
+	 */
+	static VolumeWeightBounds weightBounds(const float* volume, int width, int height, int depth, int numThreads);
+
+	void setParameters(const Parameters& parameters);
+
+	/**
+	 * \brief seed labels of the volume, kept until the next solve. The 1D initialization grows
+	 * the foreground in a copy, the labels themselves are only read.
+	 * \param labels :0: none, 1: foreground, 2: background
+	 */
+	void setSeed(const unsigned char* labels);
+
+	void solve();
+
+	float* generateProbabilityVolume() const;
+
+	float getUseTime() const;
+
+	/**
+	 * \brief number of PR iterations run by the last solve
+	 */
+	int getIterations() const;
+
+	/**
+	 * \brief max-norm change of a sweep in the last PR iteration
+	 */
+	float getResidual() const;
+
+private:
+	/**
+	 * \brief grow the foreground seeds along the lines through them. Lines are solved again only
+	 * while a crossing line grows into them.
+	 */
+	void initialization();
+
+	/**
+	 * \brief iterations of a sweep along x, y and z each
+	 * \param maxIterations
+	 */
+	void prcorrection(int maxIterations);
+
+	/**
+	 * \brief start voxels of one batch of lines along dir. Rows are batched by 16 rows of a
+	 * slice, y- and z-lines by 16 neighbouring x, so that their nodes are contiguous.
+	 * \param dir :0: x, 1: y, 2: z
+	 * \param batch
+	 * \param coords :x, y, z of each line
+	 * \return number of lines in the batch
+	 */
+	int batchLines(int dir, int batch, int* coords) const;
+
+	/**
+	 * \brief number of batches of lines along dir
+	 */
+	int numBatches(int dir) const;
+
+	/**
+	 * \brief sweep of a batch of lines along dir from solution_ to buffer_, which are swapped
+	 * after each direction
+	 * \param dir
+	 * \param coords :start voxels of the lines
+	 * \param numLines
+	 * \param scratch :5 * dims_[dir] * numLanes
+	 * \return max-norm change of the lines
+	 */
+	float sweepBatch(int dir, const int* coords, int numLines, float* scratch);
+
+	/**
+	 * \brief w * neighbour summed over both neighbours along dir, u = 0 and w = 1 outside the volume
+	 * \param u
+	 * \param index
+	 * \param position :coordinate of index along dir
+	 * \param dir
+	 * \param weight :the weights of both edges are added to it
+	 */
+	float coupling(const float* u, size_t index, int position, int dir, float& weight) const;
+
+	/**
+	 * \brief build the 1D initialization system of one line into an interleaved batch
+	 */
+	void assemble1DLine(int dir, size_t start, float* a, float* b, float* c, float* d);
+
+	/**
+	 * \brief edge weights along x, y, z and the normalized gradient
+	 * \param bounds :nullptr for the range of volume_
+	 */
+	void calculateWeightAndGradient(const VolumeWeightBounds* bounds);
+
+	int numThreads() const;
+
+	// a copy, so that the parameters cannot change during a solve
+	Parameters parameters_;
+
+	const unsigned char* seeds_;
+	// seeds_ with the foreground grown by the 1D initialization
+	unsigned char* labels_;
+
+	const float* volume_;
+	int dims_[3];
+	size_t strides_[3];
+	size_t numVoxels_;
+
+	// weight of the edge from a voxel to its next neighbour along x, y and z, in voxel order
+	WeightType* weights_[3];
+
+	WeightType* grad_;
+
+	float* solution_;
+	// result of the current sweep
+	float* buffer_;
+
+	// milliseconds of the last solve
+	float time_;
+	int iterations_;
+	float residual_;
+};
+
+#endif // CRWCRVOLUMESOLVER_H
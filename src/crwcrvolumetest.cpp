@@ -0,0 +1,197 @@
+#include "crwcrvolumesolver.h"
+#include "crwcrslabsolver.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Test of the volume path. Segments a synthetic sphere with CRWCRVolumeSolver in memory and
+ * with CRWCRSlabSolver through mapped files in several slabs, and, given the path of crwcr_cli,
+ * with crwcr_cli --volume. The files are written to the working directory.
+ */
+namespace
+{
+	const int width = 48, height = 40, depth = 40;
+	const float radius = 12;
+
+	int failures = 0;
+
+	void check(bool condition, const char* what)
+	{
+		if (!condition)
+		{
+			fprintf(stderr, "FAILED: %s\n", what);
+			failures++;
+		}
+	}
+
+	bool insideSphere(int x, int y, int z)
+	{
+		const float dx = x - width * 0.5f, dy = y - height * 0.5f, dz = z - depth * 0.5f;
+		return std::sqrt(dx * dx + dy * dy + dz * dz) < radius;
+	}
+
+	/**
+	 * \brief bright sphere on a dark background with a little noise, a foreground stroke through its
+	 * centre and background strokes near the border of every fourth slice
+	 */
+	void makeVolume(std::vector<float>& volume, std::vector<unsigned char>& labels)
+	{
+		const size_t sliceSize = size_t(width) * height;
+		volume.resize(sliceSize * depth);
+		labels.assign(sliceSize * depth, 0);
+
+		unsigned int random = 1;
+		for (int z = 0; z < depth; z++)
+		{
+			for (int y = 0; y < height; y++)
+			{
+				for (int x = 0; x < width; x++)
+				{
+					random = random * 1103515245 + 12345;
+					volume[x + y * width + z * sliceSize] = (insideSphere(x, y, z) ? 0.7f : 0.2f) +
+						((random >> 16) & 1023) / 1023.f * 0.01f;
+				}
+			}
+		}
+
+		for (int x = width / 2 - 5; x < width / 2 + 5; x++)
+		{
+			labels[x + height / 2 * width + depth / 2 * sliceSize] = 1;
+		}
+		for (int z = 0; z < depth; z += 4)
+		{
+			for (int x = 2; x < width - 2; x++)
+			{
+				labels[x + 2 * width + z * sliceSize] = 2;
+				labels[x + (height - 3) * width + z * sliceSize] = 2;
+			}
+		}
+	}
+
+	template <typename T>
+	bool writeFile(const std::string& path, const std::vector<T>& values)
+	{
+		std::ofstream file(path, std::ios::binary);
+		file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+		return bool(file);
+	}
+
+	template <typename T>
+	bool readFile(const std::string& path, std::vector<T>& values)
+	{
+		std::ifstream file(path, std::ios::binary);
+		file.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(T));
+		return file.gcount() == std::streamsize(values.size() * sizeof(T));
+	}
+
+	/**
+	 * \brief the probability map is in [0, 1] and thresholds to the sphere
+	 */
+	void checkSegmentation(const float* probability, const char* what)
+	{
+		const size_t sliceSize = size_t(width) * height;
+		// the solves keep the map in [0, 1] up to rounding
+		const float tolerance = 1e-6f;
+		size_t wrong = 0;
+		bool inRange = true;
+		for (int z = 0; z < depth; z++)
+		{
+			for (int y = 0; y < height; y++)
+			{
+				for (int x = 0; x < width; x++)
+				{
+					const float p = probability[x + y * width + z * sliceSize];
+					inRange = inRange && p >= -tolerance && p <= 1 + tolerance;
+					wrong += (p >= 0.5f) != insideSphere(x, y, z);
+				}
+			}
+		}
+
+		printf("%s: %zu voxels misclassified\n", what, wrong);
+		check(inRange, "probability in [0, 1]");
+		check(wrong == 0, "sphere segmented");
+	}
+
+	float maxDifference(const std::vector<float>& a, const float* b)
+	{
+		float difference = 0;
+		for (size_t i = 0; i < a.size(); i++)
+		{
+			difference = std::max(difference, std::fabs(a[i] - b[i]));
+		}
+		return difference;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<float> volume;
+	std::vector<unsigned char> labels;
+	makeVolume(volume, labels);
+	const std::vector<unsigned char> seeds = labels;
+
+	// whole volume in memory
+	CRWCRVolumeSolver solver(volume.data(), width, height, depth);
+	solver.setSeed(labels.data());
+	solver.solve();
+	const std::vector<float> whole(solver.generateProbabilityVolume(),
+	                               solver.generateProbabilityVolume() + volume.size());
+	checkSegmentation(whole.data(), "in memory");
+	check(labels == seeds, "seeds unchanged by the solve");
+
+	solver.solve();
+	check(maxDifference(whole, solver.generateProbabilityVolume()) == 0, "second solve equal to the first");
+
+	// slab by slab through mapped files, with a budget that splits the volume into several slabs
+	const std::string volumePath = "crwcrvolumetest.raw", labelPath = "crwcrvolumetest_labels.raw";
+	check(writeFile(volumePath, volume) && writeFile(labelPath, labels), "write the test volume");
+
+	Parameters& parameters = Singleton<Parameters>::GetInstance();
+	parameters.tileMemoryMB = 1;
+
+	CRWCRSlabSolver slabSolver(width, height, depth);
+	check(slabSolver.solve(volumePath, labelPath, "crwcrvolumetest_slabs.raw"), "slab solve");
+	printf("slabs of %d slices, %d solved\n", slabSolver.getSlabDepth(), slabSolver.getSolvedSlabs());
+	check(slabSolver.getSlabDepth() < depth, "volume split into slabs");
+
+	std::vector<float> slabs(volume.size());
+	std::vector<unsigned char> labelFile(labels.size());
+	check(readFile("crwcrvolumetest_slabs.raw", slabs), "read the slab output");
+	check(readFile(labelPath, labelFile) && labelFile == seeds, "label file unchanged by the slab solve");
+	checkSegmentation(slabs.data(), "slab by slab");
+	// the halo keeps the cuts between the slabs out of the result
+	const float difference = maxDifference(whole, slabs.data());
+	printf("max difference to the whole volume %g\n", difference);
+	check(difference < 1e-3f, "slab solve close to the whole volume");
+
+	// the command line tool on the same files, with the budget of the slab solve
+	if (argc > 1)
+	{
+		std::ofstream header(volumePath + ".hdr");
+		header << width << " " << height << " " << depth << " float32\n";
+		header.close();
+
+		std::ofstream jobs("crwcrvolumetest_jobs.txt");
+		jobs << volumePath << " " << labelPath << " crwcrvolumetest_cli.raw\n";
+		jobs.close();
+
+		const std::string command = "\"" + std::string(argv[1]) + "\" --volume --tile-memory 1 crwcrvolumetest_jobs.txt";
+		check(std::system(command.c_str()) == 0, "crwcr_cli --volume");
+
+		std::vector<float> cli(volume.size());
+		check(readFile("crwcrvolumetest_cli.raw", cli), "read the crwcr_cli output");
+		check(maxDifference(slabs, cli.data()) == 0, "crwcr_cli output equal to the slab solve");
+	}
+
+	if (failures > 0)
+	{
+		return 1;
+	}
+	printf("passed\n");
+	return 0;
+}
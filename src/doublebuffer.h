@@ -0,0 +1,80 @@
+#ifndef DOUBLEBUFFER_H
+#define DOUBLEBUFFER_H
+
+#include <mutex>
+#include <vector>
+
+
+/**
+ * \brief Two buffers handing results from one writer thread to one reader thread. The writer
+ * fills the back buffer without a lock and publishes it with swap, the reader holds the front
+ * buffer between lockFront and unlockFront, so neither waits for the other to copy.
+ * \tparam T
+ */
+template <typename T>
+class DoubleBuffer
+{
+public:
+	DoubleBuffer() :
+		front_(0)
+	{
+	}
+
+	DoubleBuffer(const DoubleBuffer&) = delete;
+	DoubleBuffer& operator=(const DoubleBuffer&) = delete;
+
+	/**
+	 * \brief the buffer to fill next, writer thread only
+	 * \param size :number of elements
+	 */
+	T* back(size_t size)
+	{
+		std::vector<T>& buffer = buffers_[1 - front_];
+		buffer.resize(size);
+		return buffer.data();
+	}
+
+	/**
+	 * \brief publish the back buffer as the front one, writer thread only
+	 */
+	void swap()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		front_ = 1 - front_;
+	}
+
+	/**
+	 * \brief drop both results, e.g. when they no longer match the image. Writer thread only,
+	 * the memory is kept for the next ones.
+	 */
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		buffers_[0].clear();
+		buffers_[1].clear();
+	}
+
+	/**
+	 * \brief the last published result, valid until unlockFront
+	 * \param size :number of elements, 0 if nothing was published
+	 */
+	const T* lockFront(size_t& size)
+	{
+		mutex_.lock();
+		size = buffers_[front_].size();
+		return buffers_[front_].data();
+	}
+
+	void unlockFront()
+	{
+		mutex_.unlock();
+	}
+
+private:
+	std::mutex mutex_;
+	std::vector<T> buffers_[2];
+	// written by swap under mutex_ only, so the writer may read it without
+	int front_;
+};
+
+#endif // DOUBLEBUFFER_H
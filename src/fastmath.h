@@ -0,0 +1,37 @@
+#ifndef FASTMATH_H
+#define FASTMATH_H
+
+#include <algorithm>
+#include <cstring>
+
+
+/**
+ * \brief exp(x) for x <= 0. Branch free, so loops over it vectorize, with a relative error
+ * of a few ulp. Arguments below -87 are clamped, exp(-87) is close to the smallest normal float.
+ * Static, so every kernel variant keeps the copy built for its own instruction set.
+ */
+static inline float expNeg(float x)
+{
+	x = x < -87.f ? -87.f : x;
+
+	// x = n * ln2 + r with |r| <= ln2 / 2, the conversion truncates towards 0 and n <= 0
+	const int n = int(x * 1.44269504f - 0.5f);
+	const float fn = float(n);
+	const float r = x - fn * 0.693359375f + fn * 2.12194440e-4f;
+
+	float p = 1.9875691500e-4f;
+	p = p * r + 1.3981999507e-3f;
+	p = p * r + 8.3334519073e-3f;
+	p = p * r + 4.1665795894e-2f;
+	p = p * r + 1.6666665459e-1f;
+	p = p * r + 5.0000001201e-1f;
+	p = p * r * r + r + 1.f;
+
+	// scale by 2^n through the exponent bits
+	const int bits = (n + 127) << 23;
+	float scale;
+	std::memcpy(&scale, &bits, sizeof(scale));
+	return p * scale;
+}
+
+#endif // FASTMATH_H
@@ -0,0 +1,105 @@
+#ifndef HALF_H
+#define HALF_H
+
+#include <cstring>
+
+// every AVX2 processor has F16C, MSVC does not announce it separately
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define HALF_HAS_F16C
+#include <immintrin.h>
+#endif
+
+
+/**
+ * \brief IEEE 754 half precision number used for storage only, arithmetic is done in float.
+ * Construction from float rounds to nearest even, toFloat converts back exactly.
+ */
+struct Half
+{
+	Half() = default;
+
+	explicit Half(float value)
+	{
+#ifdef HALF_HAS_F16C
+		bits = static_cast<unsigned short>(_cvtss_sh(value, 0));
+#else
+		unsigned int f;
+		std::memcpy(&f, &value, sizeof(f));
+
+		const unsigned int sign = f & 0x80000000u;
+		f ^= sign;
+
+		if (f >= (127u + 16) << 23)
+		{
+			// too large for half, or inf and nan
+			bits = f > 255u << 23 ? 0x7e00 : 0x7c00;
+		}
+		else if (f < 113u << 23)
+		{
+			// subnormal half or zero: adding a magic number aligns the 10 mantissa bits at the
+			// bottom of the float and rounds them to nearest even
+			const unsigned int magicBits = (127u - 15 + 23 - 10 + 1) << 23;
+			float magic, sum;
+			std::memcpy(&magic, &magicBits, sizeof(magic));
+			std::memcpy(&sum, &f, sizeof(sum));
+			sum += magic;
+			std::memcpy(&f, &sum, sizeof(f));
+			bits = static_cast<unsigned short>(f - magicBits);
+		}
+		else
+		{
+			// rebias the exponent and round the dropped 13 mantissa bits to nearest even
+			const unsigned int odd = (f >> 13) & 1;
+			f += ((15u - 127) << 23) + 0xfff + odd;
+			bits = static_cast<unsigned short>(f >> 13);
+		}
+
+		bits |= static_cast<unsigned short>(sign >> 16);
+#endif
+	}
+
+	unsigned short bits;
+};
+
+inline float toFloat(float value)
+{
+	return value;
+}
+
+inline float toFloat(Half value)
+{
+#ifdef HALF_HAS_F16C
+	return _cvtsh_ss(value.bits);
+#else
+	const unsigned int shiftedExponent = 0x7c00u << 13;
+	unsigned int f = (value.bits & 0x7fffu) << 13;
+	const unsigned int exponent = f & shiftedExponent;
+	f += (127u - 15) << 23;
+
+	float result;
+	if (exponent == shiftedExponent)
+	{
+		// inf and nan
+		f += (128u - 16) << 23;
+		std::memcpy(&result, &f, sizeof(result));
+	}
+	else if (exponent == 0)
+	{
+		// zero and subnormals, renormalized by a float subtraction
+		const unsigned int magicBits = 113u << 23;
+		float magic;
+		std::memcpy(&magic, &magicBits, sizeof(magic));
+		f += 1u << 23;
+		std::memcpy(&result, &f, sizeof(result));
+		result -= magic;
+	}
+	else
+	{
+		std::memcpy(&result, &f, sizeof(result));
+	}
+
+	return (value.bits & 0x8000) ? -result : result;
+#endif
+}
+
+#endif // HALF_H
@@ -28,17 +28,46 @@ ImageCanvas::~ImageCanvas()
 	doneCurrent();
 }
 
-void ImageCanvas::setImage(const QImage& img)
+void ImageCanvas::setImage(const ImageSource& img)
 {
+	using ImageConversion::PixelFormat;
+
 	imageDim = img.size();
 	makeCurrent();
 
+	// GL format and type of the source pixels, gray is spread over the color channels
+	GLenum format = GL_LUMINANCE, type = GL_UNSIGNED_BYTE;
+	switch (img.format())
+	{
+	case PixelFormat::Gray8:
+		break;
+	case PixelFormat::Gray16:
+		type = GL_UNSIGNED_SHORT;
+		break;
+	case PixelFormat::Float32:
+		type = GL_FLOAT;
+		break;
+	case PixelFormat::RGB888:
+		format = GL_RGB;
+		break;
+	case PixelFormat::RGBA8888:
+		format = GL_RGBA;
+		break;
+	case PixelFormat::BGRA8888:
+	case PixelFormat::ARGB8888:
+		// 0xAARRGGBB in native byte order
+		format = GL_BGRA;
+		type = GL_UNSIGNED_INT_8_8_8_8_REV;
+		break;
+	}
+
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, imageTex);
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, GLint(img.bytesPerLine() / ImageConversion::bytesPerPixel(img.format())));
 	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_DECAL);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, imageDim.width(), imageDim.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE,
-	             img.bits());
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, imageDim.width(), imageDim.height(), 0, format, type, img.data());
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 
 	clearSeeds();
 
@@ -46,12 +75,25 @@ void ImageCanvas::setImage(const QImage& img)
 	update();
 }
 
-void ImageCanvas::setProbability(float* p)
+void ImageCanvas::setProbability(const float* p)
+{
+	uploadProbability(GL_FLOAT, p);
+}
+
+void ImageCanvas::setProbability16(const unsigned short* p)
+{
+	// unsigned values are normalized on upload, the shader sees the same [0, 1] range
+	uploadProbability(GL_UNSIGNED_SHORT, p);
+}
+
+void ImageCanvas::uploadProbability(GLenum type, const void* p)
 {
 	makeCurrent();
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, probabilityTex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_INTENSITY, imageDim.width(), imageDim.height(), 0, GL_LUMINANCE, GL_FLOAT, p);
+	// 16-bit rows of odd width are not 4-byte aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_INTENSITY, imageDim.width(), imageDim.height(), 0, GL_LUMINANCE, type, p);
 
 	if (program.isLinked())
 	{
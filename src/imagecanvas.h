@@ -8,6 +8,7 @@
 #include <QOpenGLVertexArrayObject>
 
 #include"pointlistgeometry.h"
+#include "imagesource.h"
 
 /**
  * \brief seed mode enum.
@@ -31,10 +32,15 @@ public:
 	ImageCanvas(QWidget* parent = nullptr);
 	~ImageCanvas();
 
-	void setImage(const QImage& img);
+	/**
+	 * \brief upload the image in its own pixel format, the texture is a copy
+	 * \param img 
+	 */
+	void setImage(const ImageSource& img);
 
 public slots:
-	void setProbability(float* p);
+	void setProbability(const float* p);
+	void setProbability16(const unsigned short* p);
 	void setThreshold(double t);
 	void clearSeeds();
 	void setSeedMode(int mode);
@@ -58,6 +64,9 @@ private:
 
 	void initializeShader();
 
+	// upload the probability map, type is the GL pixel type of p
+	void uploadProbability(GLenum type, const void* p);
+
 	//transform mouse position to pixel coordinate
 	QPoint Window2Pixel(QPoint p);
 
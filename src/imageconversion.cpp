@@ -0,0 +1,68 @@
+#include "imageconversion.h"
+#include "kernels.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+size_t ImageConversion::bytesPerPixel(PixelFormat format)
+{
+	switch (format)
+	{
+	case PixelFormat::Gray8:
+		return 1;
+	case PixelFormat::Gray16:
+		return 2;
+	case PixelFormat::RGB888:
+		return 3;
+	default:
+		return 4;
+	}
+}
+
+void ImageConversion::toGray(const void* data, size_t bytesPerLine, int width, int height, PixelFormat format,
+                             float* gray, int numThreads)
+{
+	const Kernels::Set& kernels = Kernels::get();
+	void (*convertRow)(const unsigned char*, float*, int) = nullptr;
+
+	switch (format)
+	{
+	case PixelFormat::Gray8:
+		convertRow = kernels.gray8Row;
+		break;
+	case PixelFormat::Gray16:
+		convertRow = kernels.gray16Row;
+		break;
+	case PixelFormat::Float32:
+		convertRow = kernels.float32Row;
+		break;
+	case PixelFormat::RGB888:
+		convertRow = kernels.rgb8Row;
+		break;
+	case PixelFormat::RGBA8888:
+		convertRow = kernels.rgba8Row;
+		break;
+	case PixelFormat::BGRA8888:
+		convertRow = kernels.bgra8Row;
+		break;
+	case PixelFormat::ARGB8888:
+		convertRow = kernels.argb8Row;
+		break;
+	}
+
+#ifdef _OPENMP
+	if (numThreads <= 0)
+	{
+		numThreads = omp_get_max_threads();
+	}
+#endif
+
+	const unsigned char* src = static_cast<const unsigned char*>(data);
+
+#pragma omp parallel for num_threads(numThreads) schedule(static)
+	for (int y = 0; y < height; y++)
+	{
+		convertRow(src + y * bytesPerLine, gray + size_t(y) * width, width);
+	}
+}
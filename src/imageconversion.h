@@ -0,0 +1,48 @@
+#ifndef IMAGECONVERSION_H
+#define IMAGECONVERSION_H
+
+#include <cstddef>
+
+
+/**
+ * \brief Conversion of image buffers to the normalized gray image the solver works on,
+ * row by row straight from the source buffer.
+ */
+namespace ImageConversion
+{
+	/**
+	 * \brief memory layout of one pixel. The 4-channel formats name the byte order, e.g.
+	 * BGRA8888 is QImage::Format_RGB32 / Format_ARGB32 on little-endian machines.
+	 */
+	enum class PixelFormat
+	{
+		Gray8,
+		Gray16,
+		Float32,
+		RGB888,
+		RGBA8888,
+		BGRA8888,
+		ARGB8888
+	};
+
+	/**
+	 * \brief size of one pixel of format in bytes
+	 */
+	size_t bytesPerPixel(PixelFormat format);
+
+	/**
+	 * \brief convert to gray in [0, 1]: 0.2989 * R + 0.5870 * G + 0.1140 * B for color,
+	 * integer gray scaled by its maximum and float copied as it is
+	 * \param data :first row
+	 * \param bytesPerLine :distance between rows in the source
+	 * \param width
+	 * \param height
+	 * \param format
+	 * \param gray :width * height values
+	 * \param numThreads :0 means all available cores
+	 */
+	void toGray(const void* data, size_t bytesPerLine, int width, int height, PixelFormat format, float* gray,
+	            int numThreads);
+}
+
+#endif // IMAGECONVERSION_H
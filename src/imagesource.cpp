@@ -0,0 +1,155 @@
+#include "imagesource.h"
+#include <QFile>
+#include <QTextStream>
+
+using ImageConversion::PixelFormat;
+
+ImageSource::ImageSource() :
+	data_(nullptr),
+	bytesPerLine_(0),
+	format_(PixelFormat::Gray8)
+{
+}
+
+bool ImageSource::load(const QString& path)
+{
+	// the current image stays open until the new one is decoded
+	QImage image;
+	if (!image.load(path))
+	{
+		return false;
+	}
+
+	// the formats whose rows can be read as they are
+	PixelFormat format;
+	switch (image.format())
+	{
+	case QImage::Format_Grayscale8:
+		format = PixelFormat::Gray8;
+		break;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+	case QImage::Format_Grayscale16:
+		format = PixelFormat::Gray16;
+		break;
+#endif
+	case QImage::Format_RGB888:
+		format = PixelFormat::RGB888;
+		break;
+	case QImage::Format_RGBA8888:
+	case QImage::Format_RGBX8888:
+		format = PixelFormat::RGBA8888;
+		break;
+	case QImage::Format_RGB32:
+	case QImage::Format_ARGB32:
+		// 0xAARRGGBB in native byte order
+		format = Q_BYTE_ORDER == Q_LITTLE_ENDIAN ? PixelFormat::BGRA8888 : PixelFormat::ARGB8888;
+		break;
+	default:
+		// indexed, premultiplied and the remaining formats, gray palettes such as those of CT slices stay gray
+		if (image.isGrayscale())
+		{
+			image = image.convertToFormat(QImage::Format_Grayscale8);
+			format = PixelFormat::Gray8;
+		}
+		else
+		{
+			image = image.convertToFormat(QImage::Format_RGBA8888);
+			format = PixelFormat::RGBA8888;
+		}
+		break;
+	}
+
+	clear();
+	image_.swap(image);
+	data_ = image_.constBits();
+	bytesPerLine_ = image_.bytesPerLine();
+	dim_ = image_.size();
+	format_ = format;
+	return true;
+}
+
+bool ImageSource::loadRaw(const QString& path, QSize dim, PixelFormat format)
+{
+	const size_t bytesPerLine = dim.width() * ImageConversion::bytesPerPixel(format);
+	MappedFile file;
+	if (dim.isEmpty() || !file.openRead(path.toStdString()) || file.size() != bytesPerLine * dim.height())
+	{
+		return false;
+	}
+
+	clear();
+	file_.swap(file);
+	data_ = file_.data();
+	bytesPerLine_ = bytesPerLine;
+	dim_ = dim;
+	format_ = format;
+	return true;
+}
+
+bool ImageSource::readRawHeader(const QString& path, QSize& dim, PixelFormat& format)
+{
+	QFile file(path + ".hdr");
+	if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+	{
+		return false;
+	}
+
+	QTextStream stream(&file);
+	int width = 0, height = 0;
+	QString type;
+	stream >> width >> height >> type;
+
+	if (type == "uint8")
+	{
+		format = PixelFormat::Gray8;
+	}
+	else if (type == "uint16")
+	{
+		format = PixelFormat::Gray16;
+	}
+	else if (type == "float32")
+	{
+		format = PixelFormat::Float32;
+	}
+	else
+	{
+		return false;
+	}
+
+	dim = QSize(width, height);
+	return !dim.isEmpty();
+}
+
+bool ImageSource::isNull() const
+{
+	return data_ == nullptr;
+}
+
+const void* ImageSource::data() const
+{
+	return data_;
+}
+
+size_t ImageSource::bytesPerLine() const
+{
+	return bytesPerLine_;
+}
+
+QSize ImageSource::size() const
+{
+	return dim_;
+}
+
+PixelFormat ImageSource::format() const
+{
+	return format_;
+}
+
+void ImageSource::clear()
+{
+	image_ = QImage();
+	file_.close();
+	data_ = nullptr;
+	bytesPerLine_ = 0;
+	dim_ = QSize();
+}
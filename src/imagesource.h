@@ -0,0 +1,73 @@
+#ifndef IMAGESOURCE_H
+#define IMAGESOURCE_H
+
+#include "imageconversion.h"
+#include "mappedfile.h"
+#include <QImage>
+#include <QString>
+
+
+/**
+ * \brief An image file opened once and read in place by both the canvas and the solver.
+ * Image files are decoded by QImage and kept in the decoded format when it can be read
+ * directly. Headerless raw files are memory-mapped, they open without being read.
+ */
+class ImageSource
+{
+public:
+	ImageSource();
+
+	ImageSource(const ImageSource&) = delete;
+	ImageSource& operator=(const ImageSource&) = delete;
+
+	/**
+	 * \brief decode an image file
+	 * \param path
+	 * \return false if the file cannot be decoded, the current image is kept then
+	 */
+	bool load(const QString& path);
+
+	/**
+	 * \brief map a raw file of row-major pixels without header or row padding, 16-bit and
+	 * float values in native byte order
+	 * \param path
+	 * \param dim
+	 * \param format :Gray8, Gray16 or Float32
+	 * \return false if the file cannot be mapped or its size does not match, the current image
+	 * is kept then
+	 */
+	bool loadRaw(const QString& path, QSize dim, ImageConversion::PixelFormat format);
+
+	/**
+	 * \brief read the size and format of a raw file from the sidecar header next to it, the path
+	 * with ".hdr" appended, holding "width height type" with type uint8, uint16 or float32
+	 * \param path :path of the raw file
+	 * \param dim
+	 * \param format
+	 * \return false if there is no valid header
+	 */
+	static bool readRawHeader(const QString& path, QSize& dim, ImageConversion::PixelFormat& format);
+
+	bool isNull() const;
+
+	const void* data() const;
+
+	size_t bytesPerLine() const;
+
+	QSize size() const;
+
+	ImageConversion::PixelFormat format() const;
+
+private:
+	void clear();
+
+	QImage image_;
+	MappedFile file_;
+
+	const void* data_;
+	size_t bytesPerLine_;
+	QSize dim_;
+	ImageConversion::PixelFormat format_;
+};
+
+#endif // IMAGESOURCE_H
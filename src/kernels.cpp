@@ -0,0 +1,132 @@
+#include "kernels.h"
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define KERNELS_HAS_CPUID
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace
+{
+#ifdef KERNELS_HAS_CPUID
+	/**
+	 * \brief eax, ebx, ecx and edx of cpuid leaf, subleaf 0
+	 */
+	void cpuid(unsigned int leaf, unsigned int regs[4])
+	{
+#ifdef _MSC_VER
+		__cpuidex(reinterpret_cast<int*>(regs), leaf, 0);
+#else
+		__cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	}
+
+	/**
+	 * \brief the register states the operating system saves on a context switch
+	 */
+	unsigned long long xcr0()
+	{
+#ifdef _MSC_VER
+		return _xgetbv(0);
+#else
+		unsigned int lo, hi;
+		__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+		return (static_cast<unsigned long long>(hi) << 32) | lo;
+#endif
+	}
+#endif
+
+	/**
+	 * \brief the instruction set named by CRWCR_ISA, no limit if it is unset or unknown
+	 */
+	Kernels::Isa requestedIsa()
+	{
+		const char* value = std::getenv("CRWCR_ISA");
+		if (value == nullptr)
+		{
+			return Kernels::Isa::AVX512;
+		}
+		if (std::strcmp(value, "scalar") == 0)
+		{
+			return Kernels::Isa::Scalar;
+		}
+		if (std::strcmp(value, "avx2") == 0)
+		{
+			return Kernels::Isa::AVX2;
+		}
+		return Kernels::Isa::AVX512;
+	}
+
+	const Kernels::Set& select()
+	{
+		const Kernels::Isa detected = Kernels::detect(), requested = requestedIsa();
+		const Kernels::Isa limit = requested < detected ? requested : detected;
+
+		const Kernels::Set* variants[] = {
+			&Kernels::baseline(),
+#ifdef CRWCR_CPU_DISPATCH
+			&Kernels::avx2(),
+			&Kernels::avx512()
+#endif
+		};
+
+		// the baseline runs wherever the binary does, even if the project flags raise it above the limit
+		const Kernels::Set* best = variants[0];
+		for (const Kernels::Set* variant : variants)
+		{
+			if (variant->isa > best->isa && variant->isa <= limit)
+			{
+				best = variant;
+			}
+		}
+		return *best;
+	}
+}
+
+const Kernels::Set& Kernels::get()
+{
+	static const Set& kernels = select();
+	return kernels;
+}
+
+Kernels::Isa Kernels::detect()
+{
+#ifdef KERNELS_HAS_CPUID
+	unsigned int regs[4];
+	cpuid(0, regs);
+	if (regs[0] < 7)
+	{
+		return Isa::Scalar;
+	}
+
+	// AVX2 level: AVX, FMA and F16C, with the YMM registers saved by the operating system
+	cpuid(1, regs);
+	const unsigned int ecx = regs[2];
+	const bool fma = ecx & (1u << 12), osxsave = ecx & (1u << 27), avx = ecx & (1u << 28), f16c = ecx & (1u << 29);
+	if (!fma || !osxsave || !avx || !f16c || (xcr0() & 0x6) != 0x6)
+	{
+		return Isa::Scalar;
+	}
+
+	cpuid(7, regs);
+	const unsigned int ebx = regs[1];
+	if (!(ebx & (1u << 5)))
+	{
+		return Isa::Scalar;
+	}
+
+	// AVX-512 level: AVX-512F, with the opmask and ZMM registers saved as well
+	if ((ebx & (1u << 16)) && (xcr0() & 0xe6) == 0xe6)
+	{
+		return Isa::AVX512;
+	}
+	return Isa::AVX2;
+#else
+	return Isa::Scalar;
+#endif
+}
@@ -0,0 +1,110 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include "weighttype.h"
+#include <cstddef>
+
+
+/**
+ * \brief The hot loops of the solver and the image conversion, built once per instruction set in
+ * the same binary. The variant of the best instruction set the processor supports is chosen on
+ * first use. The environment variable CRWCR_ISA (scalar, avx2 or avx512) lowers the choice, e.g.
+ * to compare the variants on one machine.
+ */
+namespace Kernels
+{
+	enum class Isa
+	{
+		Scalar,
+		AVX2,
+		AVX512
+	};
+
+	/**
+	 * \brief the kernels of one instruction set
+	 */
+	struct Set
+	{
+		Isa isa;
+		const char* name;
+
+		// BatchTDMA, see batchtdma.h
+		void (*solve)(const float* a, const float* b, float* c, float* d, float* x, int numRow);
+		void (*factorize)(const float* a, const float* b, const float* c, float* upper, float* pivot, int numRow);
+		void (*substitute)(const float* a, const float* upper, const float* pivot, float* d, int numRow);
+		void (*substituteMany)(const float* a, const float* upper, const float* pivot, float* d, int numRow,
+		                       int numRhs);
+		void (*forwardSubstitute)(const float* a, const float* pivot, float* d, int begin, int end);
+		void (*backwardSubstitute)(const float* upper, float* d, int begin, int end, int numRow);
+		void (*reduceChunk)(float* a, const float* b, float* c, float* d, int begin, int end);
+		void (*solveChunkBorders)(const float* a, const float* c, float* d, const int* bounds, int numChunks,
+		                          float* scratch);
+		void (*substituteChunk)(const float* a, const float* c, float* d, int begin, int end);
+		void (*substituteWeights)(const WeightType* w, size_t lineStride, int numLines, const float* upper,
+		                          const float* pivot, float* d, int numRow, int numRhs);
+		void (*forwardSubstituteWeights)(const WeightType* w, size_t lineStride, int numLines, const float* pivot,
+		                                 float* d, int begin, int end);
+
+		/**
+		 * \brief map count raw edge differences and gradients in place to edge weights
+		 * exp(-beta * (v - offset) * scale) + epsilon and to gradients (v - offset) * scale
+		 * \param offset :of wx, wy and grad
+		 * \param scale :of wx, wy and grad
+		 */
+		void (*mapWeights)(WeightType* wx, WeightType* wy, WeightType* grad, int count, const float* offset,
+		                   const float* scale, float beta, float epsilon);
+
+		/**
+		 * \brief the PR right vectors of the columns [x0, x0 + count) of the image, node y of column
+		 * x0 + l at d[y * stride + l] and the lanes from count on 0. The row half step is explicit:
+		 * lambda on the seeds of label, the horizontal diffusion of u and u * dt, with u = 0 and
+		 * w = 1 outside the image.
+		 * \param u :solution
+		 * \param w :horizontal edge weights
+		 * \param labels :seeds
+		 * \param seedBegin :rows outside [seedBegin, seedEnd) hold no seeds
+		 */
+		void (*columnRhs)(const float* u, const WeightType* w, const unsigned char* labels, unsigned char label,
+		                  int seedBegin, int seedEnd, float lambda, float dt, int x0, int count, int width, int height,
+		                  float* d, int stride);
+
+		/**
+		 * \brief the PR right vectors of the rows [y0, y0 + count) of the image, node x of row y0 + l
+		 * at d[x * stride + l] and the lanes from count on 0. The column half step is explicit,
+		 * otherwise as columnRhs.
+		 * \param w :vertical edge weights, column-major
+		 * \param seedBegin :columns outside [seedBegin, seedEnd) hold no seeds
+		 */
+		void (*rowRhs)(const float* u, const WeightType* w, const unsigned char* labels, unsigned char label,
+		               int seedBegin, int seedEnd, float lambda, float dt, int y0, int count, int width, int height,
+		               float* d, int stride);
+
+		// ImageConversion, one row of every pixel format
+		void (*gray8Row)(const unsigned char* src, float* dst, int width);
+		void (*gray16Row)(const unsigned char* src, float* dst, int width);
+		void (*float32Row)(const unsigned char* src, float* dst, int width);
+		void (*rgb8Row)(const unsigned char* src, float* dst, int width);
+		void (*rgba8Row)(const unsigned char* src, float* dst, int width);
+		void (*bgra8Row)(const unsigned char* src, float* dst, int width);
+		void (*argb8Row)(const unsigned char* src, float* dst, int width);
+	};
+
+	/**
+	 * \brief the kernels the process runs with
+	 */
+	const Set& get();
+
+	/**
+	 * \brief the best instruction set the processor and the operating system support
+	 */
+	Isa detect();
+
+	// built with the flags of the whole project, in kernelsbaseline.cpp
+	const Set& baseline();
+
+	// built with USE_CPU_DISPATCH only, in kernelsavx2.cpp and kernelsavx512.cpp
+	const Set& avx2();
+	const Set& avx512();
+}
+
+#endif // KERNELS_H
@@ -0,0 +1,7 @@
+// built with AVX2, FMA and F16C, see USE_CPU_DISPATCH in CMakeLists.txt
+#ifndef __AVX2__
+#error "kernelsavx2.cpp needs AVX2"
+#endif
+
+#define KERNELS_VARIANT avx2
+#include "kernelsimpl.h"
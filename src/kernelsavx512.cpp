@@ -0,0 +1,7 @@
+// built with AVX-512F, FMA and F16C, see USE_CPU_DISPATCH in CMakeLists.txt
+#ifndef __AVX512F__
+#error "kernelsavx512.cpp needs AVX-512F"
+#endif
+
+#define KERNELS_VARIANT avx512
+#include "kernelsimpl.h"
@@ -0,0 +1,3 @@
+// built with the flags of the whole project, runs on every processor the binary runs on
+#define KERNELS_VARIANT baseline
+#include "kernelsimpl.h"
@@ -0,0 +1,729 @@
+#ifndef KERNELSIMPL_H
+#define KERNELSIMPL_H
+
+// The kernels of one instruction set. Every kernels*.cpp includes this file once, compiled with
+// its own flags, and defines KERNELS_VARIANT to the name of its Kernels entry. Everything else
+// has internal linkage, and the inline functions of other headers called here are static or
+// bypassed, so the linker cannot mix code built for different instruction sets.
+
+#include "kernels.h"
+#include "batchtdma.h"
+#include "fastmath.h"
+#include <climits>
+#include <cstring>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_IX86_FP)
+#include <xmmintrin.h>
+#define BATCHTDMA_HAS_MXCSR
+#endif
+
+namespace
+{
+	using BatchTDMA::numLanes;
+
+#if defined(__AVX512F__)
+
+	// one 512-bit register holds all 16 lanes
+	struct Lanes
+	{
+		__m512 v;
+	};
+
+	inline Lanes load(const float* p) { return {_mm512_loadu_ps(p)}; }
+	inline void store(float* p, Lanes x) { _mm512_storeu_ps(p, x.v); }
+	inline Lanes set1(float s) { return {_mm512_set1_ps(s)}; }
+	inline Lanes sub(Lanes x, Lanes y) { return {_mm512_sub_ps(x.v, y.v)}; }
+	inline Lanes mul(Lanes x, Lanes y) { return {_mm512_mul_ps(x.v, y.v)}; }
+	inline Lanes div(Lanes x, Lanes y) { return {_mm512_div_ps(x.v, y.v)}; }
+
+	const Kernels::Isa kernelIsa = Kernels::Isa::AVX512;
+	const char* kernelName = "avx512";
+
+#elif defined(__AVX2__)
+
+	// two 256-bit registers, the halves form independent dependency chains
+	struct Lanes
+	{
+		__m256 lo, hi;
+	};
+
+	inline Lanes load(const float* p) { return {_mm256_loadu_ps(p), _mm256_loadu_ps(p + 8)}; }
+
+	inline void store(float* p, Lanes x)
+	{
+		_mm256_storeu_ps(p, x.lo);
+		_mm256_storeu_ps(p + 8, x.hi);
+	}
+
+	inline Lanes set1(float s) { return {_mm256_set1_ps(s), _mm256_set1_ps(s)}; }
+	inline Lanes sub(Lanes x, Lanes y) { return {_mm256_sub_ps(x.lo, y.lo), _mm256_sub_ps(x.hi, y.hi)}; }
+	inline Lanes mul(Lanes x, Lanes y) { return {_mm256_mul_ps(x.lo, y.lo), _mm256_mul_ps(x.hi, y.hi)}; }
+	inline Lanes div(Lanes x, Lanes y) { return {_mm256_div_ps(x.lo, y.lo), _mm256_div_ps(x.hi, y.hi)}; }
+
+	const Kernels::Isa kernelIsa = Kernels::Isa::AVX2;
+	const char* kernelName = "avx2";
+
+#else
+
+	// scalar fallback, plain loops over the lanes
+	struct Lanes
+	{
+		float v[numLanes];
+	};
+
+	inline Lanes load(const float* p)
+	{
+		Lanes r;
+		for (int l = 0; l < numLanes; l++) r.v[l] = p[l];
+		return r;
+	}
+
+	inline void store(float* p, const Lanes& x)
+	{
+		for (int l = 0; l < numLanes; l++) p[l] = x.v[l];
+	}
+
+	inline Lanes set1(float s)
+	{
+		Lanes r;
+		for (int l = 0; l < numLanes; l++) r.v[l] = s;
+		return r;
+	}
+
+	inline Lanes sub(const Lanes& x, const Lanes& y)
+	{
+		Lanes r;
+		for (int l = 0; l < numLanes; l++) r.v[l] = x.v[l] - y.v[l];
+		return r;
+	}
+
+	inline Lanes mul(const Lanes& x, const Lanes& y)
+	{
+		Lanes r;
+		for (int l = 0; l < numLanes; l++) r.v[l] = x.v[l] * y.v[l];
+		return r;
+	}
+
+	inline Lanes div(const Lanes& x, const Lanes& y)
+	{
+		Lanes r;
+		for (int l = 0; l < numLanes; l++) r.v[l] = x.v[l] / y.v[l];
+		return r;
+	}
+
+	const Kernels::Isa kernelIsa = Kernels::Isa::Scalar;
+	const char* kernelName = "scalar";
+
+#endif
+
+	/**
+	 * \brief flush denormals to zero while a kernel runs. Probabilities far from the seeds decay
+	 * below the normal float range, and denormal arithmetic is two orders of magnitude slower.
+	 */
+	class DenormalGuard
+	{
+	public:
+#ifdef BATCHTDMA_HAS_MXCSR
+		DenormalGuard() : csr_(_mm_getcsr())
+		{
+			// flush to zero (bit 15) and denormals are zero (bit 6)
+			_mm_setcsr(csr_ | 0x8040);
+		}
+
+		~DenormalGuard()
+		{
+			_mm_setcsr(csr_);
+		}
+
+	private:
+		unsigned int csr_;
+#endif
+	};
+
+	// BatchTDMA, see batchtdma.h
+
+	void solve(const float* a, const float* b, float* c, float* d, float* x, int numRow)
+	{
+		DenormalGuard guard;
+
+		const Lanes one = set1(1.f);
+
+		Lanes b0 = load(b);
+		Lanes cp = div(load(c), b0);
+		Lanes dp = div(load(d), b0);
+		store(c, cp);
+		store(d, dp);
+
+		// forward sweep
+		for (int i = 1; i < numRow; ++i)
+		{
+			const int k = i * numLanes;
+			Lanes ai = load(a + k);
+			Lanes id = div(one, sub(load(b + k), mul(cp, ai)));
+			cp = mul(load(c + k), id);
+			dp = mul(sub(load(d + k), mul(ai, dp)), id);
+			store(c + k, cp);
+			store(d + k, dp);
+		}
+
+		// backward sweep
+		Lanes xp = dp;
+		store(x + (numRow - 1) * numLanes, xp);
+		for (int i = numRow - 2; i > -1; i--)
+		{
+			const int k = i * numLanes;
+			xp = sub(load(d + k), mul(load(c + k), xp));
+			store(x + k, xp);
+		}
+	}
+
+	void factorize(const float* a, const float* b, const float* c, float* upper, float* pivot, int numRow)
+	{
+		DenormalGuard guard;
+
+		const Lanes one = set1(1.f);
+
+		Lanes p = div(one, load(b));
+		Lanes u = mul(load(c), p);
+		store(pivot, p);
+		store(upper, u);
+
+		for (int i = 1; i < numRow; ++i)
+		{
+			const int k = i * numLanes;
+			p = div(one, sub(load(b + k), mul(u, load(a + k))));
+			u = mul(load(c + k), p);
+			store(pivot + k, p);
+			store(upper + k, u);
+		}
+	}
+
+	/**
+	 * \brief the sweeps of substituteMany, lower(i) gives the lower diagonal of node i
+	 */
+	template <typename Lower>
+	void substituteManyWith(const Lower& lower, const float* upper, const float* pivot, float* d, int numRow,
+	                        int numRhs)
+	{
+		DenormalGuard guard;
+
+		const int stride = numRhs * numLanes;
+
+		Lanes p = load(pivot);
+		for (int k = 0; k < numRhs; k++)
+		{
+			store(d + k * numLanes, mul(load(d + k * numLanes), p));
+		}
+
+		// the vectors are independent dependency chains, interleaving them hides the latency
+		for (int i = 1; i < numRow; ++i)
+		{
+			const Lanes ai = lower(i);
+			p = load(pivot + i * numLanes);
+			float* di = d + i * stride;
+			for (int k = 0; k < numRhs; k++)
+			{
+				const int j = k * numLanes;
+				store(di + j, mul(sub(load(di + j), mul(ai, load(di + j - stride))), p));
+			}
+		}
+
+		for (int i = numRow - 2; i >= 0; i--)
+		{
+			const Lanes ui = load(upper + i * numLanes);
+			float* di = d + i * stride;
+			for (int k = 0; k < numRhs; k++)
+			{
+				const int j = k * numLanes;
+				store(di + j, sub(load(di + j), mul(ui, load(di + j + stride))));
+			}
+		}
+	}
+
+	/**
+	 * \brief the sweep of forwardSubstitute, lower(i) gives the lower diagonal of node i
+	 */
+	template <typename Lower>
+	void forwardSubstituteWith(const Lower& lower, const float* pivot, float* d, int begin, int end)
+	{
+		DenormalGuard guard;
+
+		if (begin == 0)
+		{
+			store(d, mul(load(d), load(pivot)));
+			begin = 1;
+		}
+
+		Lanes dp = load(d + (begin - 1) * numLanes);
+		for (int i = begin; i < end; ++i)
+		{
+			const int k = i * numLanes;
+			dp = mul(sub(load(d + k), mul(lower(i), dp)), load(pivot + k));
+			store(d + k, dp);
+		}
+	}
+
+	/**
+	 * \brief lower diagonal stored interleaved
+	 */
+	struct ArrayLower
+	{
+		const float* a;
+
+		Lanes operator()(int i) const { return load(a + i * numLanes); }
+	};
+
+	void substituteMany(const float* a, const float* upper, const float* pivot, float* d, int numRow, int numRhs)
+	{
+		substituteManyWith(ArrayLower{a}, upper, pivot, d, numRow, numRhs);
+	}
+
+	void forwardSubstitute(const float* a, const float* pivot, float* d, int begin, int end)
+	{
+		forwardSubstituteWith(ArrayLower{a}, pivot, d, begin, end);
+	}
+
+	void backwardSubstitute(const float* upper, float* d, int begin, int end, int numRow)
+	{
+		DenormalGuard guard;
+
+		// the last node is already solved by the forward sweep
+		if (end == numRow)
+		{
+			end = numRow - 1;
+		}
+
+		Lanes dp = load(d + end * numLanes);
+		for (int i = end - 1; i >= begin; i--)
+		{
+			const int k = i * numLanes;
+			dp = sub(load(d + k), mul(load(upper + k), dp));
+			store(d + k, dp);
+		}
+	}
+
+	void substitute(const float* a, const float* upper, const float* pivot, float* d, int numRow)
+	{
+		forwardSubstitute(a, pivot, d, 0, numRow);
+		backwardSubstitute(upper, d, 0, numRow, numRow);
+	}
+
+	void reduceChunk(float* a, const float* b, float* c, float* d, int begin, int end)
+	{
+		DenormalGuard guard;
+
+		const Lanes one = set1(1.f);
+		const int first = begin * numLanes, second = first + numLanes;
+
+		// forward: the first two nodes are only normalized, the later ones eliminate their lower
+		// neighbour and take its coupling to the first node instead
+		for (int k = first; k <= second; k += numLanes)
+		{
+			const Lanes p = div(one, load(b + k));
+			store(a + k, mul(load(a + k), p));
+			store(c + k, mul(load(c + k), p));
+			store(d + k, mul(load(d + k), p));
+		}
+
+		Lanes ap = load(a + second), cp = load(c + second), dp = load(d + second);
+		for (int i = begin + 2; i < end; i++)
+		{
+			const int k = i * numLanes;
+			const Lanes ai = load(a + k);
+			const Lanes p = div(one, sub(load(b + k), mul(ai, cp)));
+			dp = mul(sub(load(d + k), mul(ai, dp)), p);
+			ap = mul(sub(set1(0.f), mul(ai, ap)), p);
+			cp = mul(load(c + k), p);
+			store(a + k, ap);
+			store(c + k, cp);
+			store(d + k, dp);
+		}
+
+		// backward: the inner nodes eliminate their upper neighbour and take its coupling to the last node
+		const int last = (end - 1) * numLanes;
+		ap = load(a + last - numLanes);
+		cp = load(c + last - numLanes);
+		dp = load(d + last - numLanes);
+		for (int k = last - 2 * numLanes; k >= second; k -= numLanes)
+		{
+			const Lanes ci = load(c + k);
+			dp = sub(load(d + k), mul(ci, dp));
+			ap = sub(load(a + k), mul(ci, ap));
+			cp = sub(set1(0.f), mul(ci, cp));
+			store(a + k, ap);
+			store(c + k, cp);
+			store(d + k, dp);
+		}
+
+		// the first node eliminates the second one
+		const Lanes c0 = load(c + first);
+		const Lanes p = div(one, sub(one, mul(c0, load(a + second))));
+		store(d + first, mul(sub(load(d + first), mul(c0, load(d + second))), p));
+		store(a + first, mul(load(a + first), p));
+		store(c + first, mul(sub(set1(0.f), mul(c0, load(c + second))), p));
+	}
+
+	void solveChunkBorders(const float* a, const float* c, float* d, const int* bounds, int numChunks, float* scratch)
+	{
+		DenormalGuard guard;
+
+		const Lanes one = set1(1.f);
+		const int numNodes = 2 * numChunks;
+
+		// node j of the border system is the first (even j) or last (odd j) node of chunk j / 2,
+		// its diagonal is 1
+		auto node = [&](int j) { return (j % 2 == 0 ? bounds[j / 2] : bounds[j / 2 + 1] - 1) * numLanes; };
+
+		Lanes cp = load(c + node(0));
+		Lanes dp = load(d + node(0));
+		store(scratch, cp);
+		for (int j = 1; j < numNodes; j++)
+		{
+			const int k = node(j);
+			const Lanes aj = load(a + k);
+			const Lanes p = div(one, sub(one, mul(aj, cp)));
+			dp = mul(sub(load(d + k), mul(aj, dp)), p);
+			cp = mul(load(c + k), p);
+			store(scratch + j * numLanes, cp);
+			store(d + k, dp);
+		}
+
+		for (int j = numNodes - 2; j >= 0; j--)
+		{
+			const int k = node(j);
+			dp = sub(load(d + k), mul(load(scratch + j * numLanes), dp));
+			store(d + k, dp);
+		}
+	}
+
+	void substituteChunk(const float* a, const float* c, float* d, int begin, int end)
+	{
+		DenormalGuard guard;
+
+		const Lanes first = load(d + begin * numLanes), last = load(d + (end - 1) * numLanes);
+		for (int i = begin + 1; i < end - 1; i++)
+		{
+			const int k = i * numLanes;
+			store(d + k, sub(sub(load(d + k), mul(load(a + k), first)), mul(load(c + k), last)));
+		}
+	}
+
+	/**
+	 * \brief weight conversions through intrinsics where possible, see the note at the top
+	 */
+	inline float fromWeight(float w)
+	{
+		return w;
+	}
+
+	inline float toWeight(float v, float)
+	{
+		return v;
+	}
+
+	inline float fromWeight(Half w)
+	{
+#ifdef HALF_HAS_F16C
+		return _cvtsh_ss(w.bits);
+#else
+		return toFloat(w);
+#endif
+	}
+
+	inline Half toWeight(float v, Half)
+	{
+#ifdef HALF_HAS_F16C
+		Half h;
+		h.bits = static_cast<unsigned short>(_cvtss_sh(v, 0));
+		return h;
+#else
+		return Half(v);
+#endif
+	}
+
+	void mapWeights(WeightType* wx, WeightType* wy, WeightType* grad, int count, const float* offset,
+	                const float* scale, float beta, float epsilon)
+	{
+		const float betaX = -beta * scale[0], betaY = -beta * scale[1];
+		const WeightType type = WeightType();
+
+		for (int i = 0; i < count; i++)
+		{
+			wx[i] = toWeight(expNeg(betaX * (fromWeight(wx[i]) - offset[0])) + epsilon, type);
+			wy[i] = toWeight(expNeg(betaY * (fromWeight(wy[i]) - offset[1])) + epsilon, type);
+			grad[i] = toWeight((fromWeight(grad[i]) - offset[2]) * scale[2], type);
+		}
+	}
+
+	inline float explicitTerm(float seed, float uLeft, float u, float uRight, float wLeft, float wRight, float dt)
+	{
+		return seed + wLeft * (uLeft - u) + wRight * (uRight - u) + u * dt;
+	}
+
+	/**
+	 * \brief the right vector of the pixels [x0, x0 + count) of one image row
+	 */
+	inline void explicitRow(const float* u, const WeightType* w, const unsigned char* labels, unsigned char label,
+	                        float lambda, float dt, int x0, int count, int width, float* d)
+	{
+		const int x1 = x0 + count;
+
+		// u = 0 and w = 1 outside the image
+		auto border = [&](int x)
+		{
+			const float seed = labels != nullptr && labels[x] == label ? lambda : 0;
+			const float uLeft = x > 0 ? u[x - 1] : 0, uRight = x < width - 1 ? u[x + 1] : 0;
+			const float wLeft = x > 0 ? fromWeight(w[x - 1]) : 1, wRight = x < width - 1 ? fromWeight(w[x]) : 1;
+			d[x - x0] = explicitTerm(seed, uLeft, u[x], uRight, wLeft, wRight, dt);
+		};
+
+		if (x0 == 0)
+		{
+			border(0);
+		}
+
+		const int inner0 = x0 > 1 ? x0 : 1, inner1 = x1 < width - 1 ? x1 : width - 1;
+		if (labels != nullptr)
+		{
+			for (int x = inner0; x < inner1; x++)
+			{
+				d[x - x0] = explicitTerm(labels[x] == label ? lambda : 0, u[x - 1], u[x], u[x + 1],
+				                         fromWeight(w[x - 1]), fromWeight(w[x]), dt);
+			}
+		}
+		else
+		{
+			for (int x = inner0; x < inner1; x++)
+			{
+				d[x - x0] = explicitTerm(0, u[x - 1], u[x], u[x + 1], fromWeight(w[x - 1]), fromWeight(w[x]), dt);
+			}
+		}
+
+		if (x1 == width && width > 1)
+		{
+			border(width - 1);
+		}
+	}
+
+#if !defined(CRWCR_COMPACT_MEMORY) && defined(__AVX512F__)
+	inline Lanes gatherLower(const float* w, int stride)
+	{
+		const __m512i index = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+		                                         _mm512_set1_epi32(stride));
+		const __m512 zero = _mm512_setzero_ps();
+		return {_mm512_sub_ps(zero, _mm512_mask_i32gather_ps(zero, 0xffff, index, w, 4))};
+	}
+#elif !defined(CRWCR_COMPACT_MEMORY) && defined(__AVX2__)
+	inline Lanes gatherLower(const float* w, int stride)
+	{
+		const __m256i index = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+		const __m256 zero = _mm256_setzero_ps();
+		return {_mm256_sub_ps(zero, _mm256_i32gather_ps(w, index, 4)),
+		        _mm256_sub_ps(zero, _mm256_i32gather_ps(w + size_t(stride) * 8, index, 4))};
+	}
+#endif
+
+	/**
+	 * \brief lower diagonal of PR lines read from their edge weights: -w of the edge to node
+	 * i - 1, line l at w + l * lineStride, 0 in the lanes from numLines on
+	 */
+	struct WeightLower
+	{
+		const WeightType* w;
+		size_t lineStride;
+		int numLines;
+
+		Lanes operator()(int i) const
+		{
+#if !defined(CRWCR_COMPACT_MEMORY) && (defined(__AVX512F__) || defined(__AVX2__))
+			// full batches gather the 16 weights at once
+			if (numLines == numLanes && lineStride * (numLanes - 1) <= size_t(INT_MAX))
+			{
+				return gatherLower(w + i - 1, int(lineStride));
+			}
+#endif
+			float a[numLanes];
+			for (int l = 0; l < numLines; l++)
+			{
+				a[l] = -fromWeight(w[l * lineStride + i - 1]);
+			}
+			for (int l = numLines; l < numLanes; l++)
+			{
+				a[l] = 0;
+			}
+			return load(a);
+		}
+	};
+
+	void substituteWeights(const WeightType* w, size_t lineStride, int numLines, const float* upper,
+	                       const float* pivot, float* d, int numRow, int numRhs)
+	{
+		const WeightLower lower = {w, lineStride, numLines};
+		if (numRhs == 1)
+		{
+			forwardSubstituteWith(lower, pivot, d, 0, numRow);
+			backwardSubstitute(upper, d, 0, numRow, numRow);
+		}
+		else
+		{
+			substituteManyWith(lower, upper, pivot, d, numRow, numRhs);
+		}
+	}
+
+	void forwardSubstituteWeights(const WeightType* w, size_t lineStride, int numLines, const float* pivot, float* d,
+	                              int begin, int end)
+	{
+		forwardSubstituteWith(WeightLower{w, lineStride, numLines}, pivot, d, begin, end);
+	}
+
+	void columnRhs(const float* u, const WeightType* w, const unsigned char* labels, unsigned char label,
+	               int seedBegin, int seedEnd, float lambda, float dt, int x0, int count, int width, int height,
+	               float* d, int stride)
+	{
+		for (int y = 0; y < height; y++)
+		{
+			const size_t row = size_t(y) * width;
+			float* dy = d + size_t(y) * stride;
+			explicitRow(u + row, w + row, y >= seedBegin && y < seedEnd ? labels + row : nullptr, label, lambda, dt,
+			            x0, count, width, dy);
+
+			for (int l = count; l < numLanes; l++)
+			{
+				dy[l] = 0;
+			}
+		}
+	}
+
+	void rowRhs(const float* u, const WeightType* w, const unsigned char* labels, unsigned char label,
+	            int seedBegin, int seedEnd, float lambda, float dt, int y0, int count, int width, int height,
+	            float* d, int stride)
+	{
+		// node by node so that d is written contiguously, the weights of a column are contiguous too
+		for (int x = 0; x < width; x++)
+		{
+			const WeightType* wx = w + size_t(x) * height;
+			const bool seeded = x >= seedBegin && x < seedEnd;
+			float* dx = d + size_t(x) * stride;
+
+			for (int l = 0; l < count; l++)
+			{
+				const int y = y0 + l;
+				const size_t index = x + size_t(y) * width;
+				const float seed = seeded && labels[index] == label ? lambda : 0;
+				const float uUp = y > 0 ? u[index - width] : 0, uDown = y < height - 1 ? u[index + width] : 0;
+				const float wUp = y > 0 ? fromWeight(wx[y - 1]) : 1, wDown = y < height - 1 ? fromWeight(wx[y]) : 1;
+				dx[l] = explicitTerm(seed, uUp, u[index], uDown, wUp, wDown, dt);
+			}
+
+			for (int l = count; l < numLanes; l++)
+			{
+				dx[l] = 0;
+			}
+		}
+	}
+
+	// ImageConversion, rgb2gray: 0.2989 * R + 0.5870 * G + 0.1140 * B, normalized to [0,1]
+	const float redWeight = 0.2989f / 255;
+	const float greenWeight = 0.5870f / 255;
+	const float blueWeight = 0.1140f / 255;
+
+	/**
+	 * \brief one row of a 4-channel format, R, G and B at byte R, G, B of each pixel
+	 */
+	template <int R, int G, int B>
+	void rgba8Row(const unsigned char* src, float* dst, int width)
+	{
+		int x = 0;
+
+#if defined(__AVX2__)
+		// 8 pixels per step, each a 32-bit lane, the channels are shifted out of the lane
+		const __m256i mask = _mm256_set1_epi32(0xff);
+		const __m256 red = _mm256_set1_ps(redWeight);
+		const __m256 green = _mm256_set1_ps(greenWeight);
+		const __m256 blue = _mm256_set1_ps(blueWeight);
+
+		for (; x + 8 <= width; x += 8)
+		{
+			const __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 4 * x));
+			const __m256 r = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(p, 8 * R), mask));
+			const __m256 g = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(p, 8 * G), mask));
+			const __m256 b = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(p, 8 * B), mask));
+			const __m256 sum = _mm256_add_ps(_mm256_mul_ps(r, red), _mm256_mul_ps(g, green));
+			_mm256_storeu_ps(dst + x, _mm256_add_ps(sum, _mm256_mul_ps(b, blue)));
+		}
+#endif
+
+		for (; x < width; x++)
+		{
+			const unsigned char* p = src + 4 * x;
+			dst[x] = redWeight * p[R] + greenWeight * p[G] + blueWeight * p[B];
+		}
+	}
+
+	void rgb8Row(const unsigned char* src, float* dst, int width)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			const unsigned char* p = src + 3 * x;
+			dst[x] = redWeight * p[0] + greenWeight * p[1] + blueWeight * p[2];
+		}
+	}
+
+	void gray8Row(const unsigned char* src, float* dst, int width)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			dst[x] = src[x] * (1.f / 255);
+		}
+	}
+
+	void gray16Row(const unsigned char* src, float* dst, int width)
+	{
+		const unsigned short* p = reinterpret_cast<const unsigned short*>(src);
+		for (int x = 0; x < width; x++)
+		{
+			dst[x] = p[x] * (1.f / 65535);
+		}
+	}
+
+	void float32Row(const unsigned char* src, float* dst, int width)
+	{
+		memcpy(dst, src, width * sizeof(float));
+	}
+}
+
+const Kernels::Set& Kernels::KERNELS_VARIANT()
+{
+	static const Set kernels = {
+		kernelIsa,
+		kernelName,
+		solve,
+		factorize,
+		substitute,
+		substituteMany,
+		forwardSubstitute,
+		backwardSubstitute,
+		reduceChunk,
+		solveChunkBorders,
+		substituteChunk,
+		substituteWeights,
+		forwardSubstituteWeights,
+		mapWeights,
+		columnRhs,
+		rowRhs,
+		gray8Row,
+		gray16Row,
+		float32Row,
+		rgb8Row,
+		rgba8Row<0, 1, 2>,
+		rgba8Row<2, 1, 0>,
+		rgba8Row<1, 2, 3>
+	};
+	return kernels;
+}
+
+#endif // KERNELSIMPL_H
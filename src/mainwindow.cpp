@@ -3,6 +3,7 @@
 #include"toolpanel.h"
 
 #include "crwcralgorithm.h"
+#include "profiler.h"
 
 #include <QtWidgets>
 
@@ -11,7 +12,11 @@ MainWindow::MainWindow(QWidget* parent)
 {
 	imageCanvas_ = new ImageCanvas(this);
 
+	// the solve runs on the worker thread, so the window stays responsive
 	algorithm_ = new CRWCRAlgorithm();
+	algorithm_->moveToThread(&workerThread_);
+	connect(&workerThread_, &QThread::finished, algorithm_, &QObject::deleteLater);
+	workerThread_.start();
 
 	lastDir_ = "";
 
@@ -25,7 +30,10 @@ MainWindow::MainWindow(QWidget* parent)
 
 MainWindow::~MainWindow()
 {
-	delete algorithm_;
+	// the algorithm is deleted on the worker thread once its event loop quits
+	algorithm_->cancel();
+	workerThread_.quit();
+	workerThread_.wait();
 	algorithm_ = nullptr;
 }
 
@@ -44,12 +52,17 @@ void MainWindow::createConnect()
 {
 	connect(toolWidget_, &ToolPanel::loadImage, this, &MainWindow::load);
 	connect(toolWidget_, &ToolPanel::seedModeChanged, imageCanvas_, &ImageCanvas::setSeedMode);
-	connect(toolWidget_, &ToolPanel::computerClicked, algorithm_, &CRWCRAlgorithm::process);
+	connect(toolWidget_, &ToolPanel::computerClicked, algorithm_, &CRWCRAlgorithm::requestProcess);
+	connect(toolWidget_, &ToolPanel::cancelClicked, algorithm_, &CRWCRAlgorithm::cancel, Qt::DirectConnection);
 	connect(toolWidget_, &ToolPanel::clearSeeds, imageCanvas_, &ImageCanvas::clearSeeds);
 	connect(toolWidget_, &ToolPanel::thresholdChanged, imageCanvas_, &ImageCanvas::setThreshold);
 	connect(toolWidget_, &ToolPanel::preProcessCheckChanged, algorithm_, &CRWCRAlgorithm::setPreProcessState);
-	connect(algorithm_, &CRWCRAlgorithm::segmentationDone, imageCanvas_, &ImageCanvas::setProbability);
+	connect(algorithm_, &CRWCRAlgorithm::segmentationDone, this, &MainWindow::showSegmentation);
+	connect(algorithm_, &CRWCRAlgorithm::segmentationPreview, this, &MainWindow::showSegmentation);
+	connect(algorithm_, &CRWCRAlgorithm::progressChanged, toolWidget_, &ToolPanel::progressChanged);
 	connect(algorithm_, &CRWCRAlgorithm::segmentationTime, toolWidget_, &ToolPanel::computeTimeChanged);
+	connect(algorithm_, &CRWCRAlgorithm::segmentationProfile, toolWidget_, &ToolPanel::profileChanged);
+	connect(toolWidget_, &ToolPanel::exportTrace, this, &MainWindow::exportTrace);
 	connect(imageCanvas_, &ImageCanvas::seedChanged, algorithm_, &CRWCRAlgorithm::setSeeds);
 }
 
@@ -74,8 +87,93 @@ void MainWindow::load()
 
 	lastDir_ = filename;
 
-	QImage image(filename);
-	image = image.convertToFormat(QImage::Format_RGBA8888);
-	imageCanvas_->setImage(image);
-	algorithm_->setImage(image);
+	bool loaded;
+	if (QFileInfo(filename).suffix().compare("raw", Qt::CaseInsensitive) == 0)
+	{
+		QSize dim;
+		ImageConversion::PixelFormat format;
+		if (!ImageSource::readRawHeader(filename, dim, format) && !askRawFormat(dim, format))
+		{
+			return;
+		}
+		loaded = image_.loadRaw(filename, dim, format);
+	}
+	else
+	{
+		loaded = image_.load(filename);
+	}
+
+	if (!loaded)
+	{
+		QMessageBox::warning(this, "Open Image", tr("Cannot read %1").arg(filename));
+		return;
+	}
+
+	imageCanvas_->setImage(image_);
+
+	// stop and drop the solves of the last image, then wait for the worker to take the new one over
+	algorithm_->cancel();
+	QMetaObject::invokeMethod(algorithm_, [this]() { algorithm_->setImage(image_); }, Qt::BlockingQueuedConnection);
+}
+
+void MainWindow::showSegmentation()
+{
+	ProbabilityBuffer& probability = algorithm_->getProbability();
+
+	size_t size;
+	const auto* p = probability.lockFront(size);
+	// the map of an image loaded before is dropped by setImage
+	const QSize dim = image_.size();
+	if (size == size_t(dim.width()) * dim.height())
+	{
+#if defined(CRWCR_COMPACT_MEMORY) && !defined(USE_GPU)
+		imageCanvas_->setProbability16(p);
+#else
+		imageCanvas_->setProbability(p);
+#endif
+	}
+	probability.unlockFront();
+}
+
+void MainWindow::exportTrace()
+{
+	QString filename = QFileDialog::getSaveFileName(this, "Export Trace", lastDir_, tr("Chrome Trace (*.json)"));
+	if (filename.isEmpty())
+	{
+		return;
+	}
+
+	if (!Singleton<Profiler>::GetInstance().exportTrace(filename.toStdString()))
+	{
+		QMessageBox::warning(this, "Export Trace", tr("Cannot write %1").arg(filename));
+	}
+}
+
+bool MainWindow::askRawFormat(QSize& dim, ImageConversion::PixelFormat& format)
+{
+	bool ok;
+	const int width = QInputDialog::getInt(this, "Raw Image", "Width", 512, 1, 1 << 20, 1, &ok);
+	if (!ok)
+	{
+		return false;
+	}
+	const int height = QInputDialog::getInt(this, "Raw Image", "Height", width, 1, 1 << 20, 1, &ok);
+	if (!ok)
+	{
+		return false;
+	}
+
+	const QStringList types = {"uint8", "uint16", "float32"};
+	const QString type = QInputDialog::getItem(this, "Raw Image", "Pixel type", types, 1, false, &ok);
+	if (!ok)
+	{
+		return false;
+	}
+
+	const ImageConversion::PixelFormat formats[] = {
+		ImageConversion::PixelFormat::Gray8, ImageConversion::PixelFormat::Gray16, ImageConversion::PixelFormat::Float32
+	};
+	dim = QSize(width, height);
+	format = formats[types.indexOf(type)];
+	return true;
 }
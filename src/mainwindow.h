@@ -2,6 +2,8 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QThread>
+#include "imagesource.h"
 
 class ImageCanvas;
 class ToolPanel;
@@ -24,17 +26,37 @@ public slots:
 
 	void load();
 
+	/**
+	 * \brief save the profiler events as a Chrome trace
+	 */
+	void exportTrace();
+
+	/**
+	 * \brief show the probability map the algorithm published last
+	 */
+	void showSegmentation();
+
 private:
 
 	void createDockWidget();
 	void createConnect();
 
+	/**
+	 * \brief ask for the size and pixel type of a raw file without sidecar header
+	 * \return false if the dialog was cancelled
+	 */
+	bool askRawFormat(QSize& dim, ImageConversion::PixelFormat& format);
+
 	ImageCanvas* imageCanvas_;
 	ToolPanel* toolWidget_;
 
 	CRWCRAlgorithm* algorithm_;
+	QThread workerThread_;
 
 	QString lastDir_;
+
+	// the loaded image, read by the canvas and the algorithm
+	ImageSource image_;
 };
 
 #endif // MAINWINDOW_H
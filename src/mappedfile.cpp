@@ -0,0 +1,245 @@
+#include "mappedfile.h"
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() :
+	data_(nullptr),
+	size_(0),
+	writable_(false),
+#ifdef _WIN32
+	file_(INVALID_HANDLE_VALUE),
+	mapping_(nullptr)
+#else
+	file_(-1)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::openRead(const std::string& path)
+{
+	close();
+
+	file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+	                    FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	LARGE_INTEGER size;
+	if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size) || size.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+
+	mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	data_ = mapping_ ? static_cast<char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+	if (data_ == nullptr)
+	{
+		close();
+		return false;
+	}
+
+	size_ = size_t(size.QuadPart);
+	writable_ = false;
+	return true;
+}
+
+bool MappedFile::create(const std::string& path, size_t size)
+{
+	close();
+
+	file_ = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+	                    FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file_ == INVALID_HANDLE_VALUE || size == 0)
+	{
+		close();
+		return false;
+	}
+
+	// mapping a writable view extends the file to the mapping size
+	const unsigned long long size64 = size;
+	mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READWRITE, DWORD(size64 >> 32), DWORD(size64), nullptr);
+	data_ = mapping_ ? static_cast<char*>(MapViewOfFile(mapping_, FILE_MAP_WRITE, 0, 0, 0)) : nullptr;
+	if (data_ == nullptr)
+	{
+		close();
+		return false;
+	}
+
+	size_ = size;
+	writable_ = true;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (data_)
+	{
+		if (writable_)
+		{
+			FlushViewOfFile(data_, 0);
+		}
+		UnmapViewOfFile(data_);
+	}
+	if (mapping_)
+	{
+		CloseHandle(mapping_);
+	}
+	if (file_ != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(file_);
+	}
+
+	data_ = nullptr;
+	size_ = 0;
+	mapping_ = nullptr;
+	file_ = INVALID_HANDLE_VALUE;
+}
+
+void MappedFile::release(size_t offset, size_t length)
+{
+	if (data_ == nullptr || offset >= size_)
+	{
+		return;
+	}
+
+	length = offset + length > size_ ? size_ - offset : length;
+	if (writable_)
+	{
+		FlushViewOfFile(data_ + offset, length);
+	}
+	// unlocking pages that are not locked removes them from the working set
+	VirtualUnlock(data_ + offset, length);
+}
+
+#else
+
+bool MappedFile::openRead(const std::string& path)
+{
+	close();
+
+	file_ = ::open(path.c_str(), O_RDONLY);
+	struct stat status;
+	if (file_ < 0 || fstat(file_, &status) != 0 || status.st_size == 0)
+	{
+		close();
+		return false;
+	}
+
+	void* data = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_SHARED, file_, 0);
+	if (data == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+
+	data_ = static_cast<char*>(data);
+	size_ = size_t(status.st_size);
+	writable_ = false;
+	return true;
+}
+
+bool MappedFile::create(const std::string& path, size_t size)
+{
+	close();
+
+	file_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (file_ < 0 || size == 0 || ftruncate(file_, off_t(size)) != 0)
+	{
+		close();
+		return false;
+	}
+
+	void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file_, 0);
+	if (data == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+
+	data_ = static_cast<char*>(data);
+	size_ = size;
+	writable_ = true;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (data_)
+	{
+		if (writable_)
+		{
+			msync(data_, size_, MS_SYNC);
+		}
+		munmap(data_, size_);
+	}
+	if (file_ >= 0)
+	{
+		::close(file_);
+	}
+
+	data_ = nullptr;
+	size_ = 0;
+	file_ = -1;
+}
+
+void MappedFile::release(size_t offset, size_t length)
+{
+	if (data_ == nullptr || offset >= size_)
+	{
+		return;
+	}
+
+	// madvise works on whole pages, only drop pages that lie completely inside the range
+	const size_t page = size_t(sysconf(_SC_PAGESIZE));
+	const size_t end = offset + length > size_ ? size_ : offset + length;
+	const size_t begin = (offset + page - 1) / page * page;
+	const size_t stop = end == size_ ? end : end / page * page;
+	if (begin >= stop)
+	{
+		return;
+	}
+
+	if (writable_)
+	{
+		msync(data_ + begin, stop - begin, MS_ASYNC);
+	}
+	// the pages of a shared mapping are kept in the page cache and are written back from there
+	madvise(data_ + begin, stop - begin, MADV_DONTNEED);
+}
+
+#endif
+
+void MappedFile::swap(MappedFile& other)
+{
+	std::swap(data_, other.data_);
+	std::swap(size_, other.size_);
+	std::swap(writable_, other.writable_);
+	std::swap(file_, other.file_);
+#ifdef _WIN32
+	std::swap(mapping_, other.mapping_);
+#endif
+}
+
+char* MappedFile::data() const
+{
+	return data_;
+}
+
+size_t MappedFile::size() const
+{
+	return size_;
+}
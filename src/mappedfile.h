@@ -0,0 +1,68 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+
+
+/**
+ * \brief A file mapped into memory as a whole. Pages are read from and written back to the
+ * file by the OS on demand, so files larger than the physical memory can be accessed.
+ */
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/**
+	 * \brief map an existing file read-only
+	 * \param path 
+	 * \return false if the file cannot be opened or mapped
+	 */
+	bool openRead(const std::string& path);
+
+	/**
+	 * \brief create a file of size bytes, replacing an existing one, and map it for writing
+	 * \param path 
+	 * \param size 
+	 * \return false if the file cannot be created or mapped
+	 */
+	bool create(const std::string& path, size_t size);
+
+	void close();
+
+	/**
+	 * \brief write back the pages of [offset, offset + length) and drop them from the working set
+	 * of the process. The data stays in the file, the range can still be accessed afterwards.
+	 * \param offset 
+	 * \param length 
+	 */
+	void release(size_t offset, size_t length);
+
+	/**
+	 * \brief exchange the mappings of two files
+	 * \param other 
+	 */
+	void swap(MappedFile& other);
+
+	char* data() const;
+
+	size_t size() const;
+
+private:
+	char* data_;
+	size_t size_;
+	bool writable_;
+
+#ifdef _WIN32
+	void* file_;
+	void* mapping_;
+#else
+	int file_;
+#endif
+};
+
+#endif // MAPPEDFILE_H
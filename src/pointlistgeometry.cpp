@@ -25,7 +25,7 @@ size_t PointListGeometry::getSegmentNums() const
 	return pointList_.size();
 }
 
-PointSegment PointListGeometry::getSegment(int index) const
+const PointSegment& PointListGeometry::getSegment(int index) const
 {
 	return pointList_.at(index);
 }
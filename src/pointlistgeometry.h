@@ -28,7 +28,7 @@ public:
 
 	size_t getSegmentNums() const;
 
-	PointSegment getSegment(int index) const;
+	const PointSegment& getSegment(int index) const;
 
 	void clear();
 
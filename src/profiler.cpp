@@ -0,0 +1,163 @@
+#include "profiler.h"
+#include <algorithm>
+#include <cstdio>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+Profiler::Profiler() :
+	origin_(Clock::now()),
+	peakMemory_(0)
+{
+}
+
+bool Profiler::isEnabled()
+{
+#ifdef CRWCR_PROFILING
+	return true;
+#else
+	return false;
+#endif
+}
+
+void Profiler::record(const char* name, Clock::time_point start, Clock::time_point stop)
+{
+	const size_t memory = residentMemory();
+	const std::thread::id id = std::this_thread::get_id();
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	int thread = int(std::find(threads_.begin(), threads_.end(), id) - threads_.begin());
+	if (thread == int(threads_.size()))
+	{
+		threads_.push_back(id);
+	}
+
+	events_.push_back({name, start, stop, thread, memory});
+	peakMemory_ = std::max(peakMemory_, memory);
+}
+
+void Profiler::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	events_.clear();
+	origin_ = Clock::now();
+	peakMemory_ = 0;
+}
+
+size_t Profiler::getNumEvents() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return events_.size();
+}
+
+std::vector<Profiler::Event> Profiler::getEvents() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return events_;
+}
+
+std::vector<std::pair<std::string, double>> Profiler::getSummary(size_t first) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	std::vector<std::pair<std::string, double>> summary;
+	for (size_t i = first; i < events_.size(); i++)
+	{
+		const Event& e = events_[i];
+		auto phase = std::find_if(summary.begin(), summary.end(),
+		                          [&](const std::pair<std::string, double>& p) { return p.first == e.name; });
+		if (phase == summary.end())
+		{
+			summary.emplace_back(e.name, 0.0);
+			phase = summary.end() - 1;
+		}
+		phase->second += std::chrono::duration<double, std::milli>(e.stop - e.start).count();
+	}
+	return summary;
+}
+
+size_t Profiler::getPeakMemory() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return peakMemory_;
+}
+
+bool Profiler::exportTrace(const std::string& path) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	FILE* file = fopen(path.c_str(), "w");
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	auto micro = [this](Clock::time_point t) { return std::chrono::duration<double, std::micro>(t - origin_).count(); };
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"CRWCR\"}}");
+	for (size_t t = 0; t < threads_.size(); t++)
+	{
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"thread %zu\"}}",
+		        t, t);
+	}
+
+	for (const Event& e : events_)
+	{
+		fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"crwcr\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+		        e.name, e.thread, micro(e.start), micro(e.stop) - micro(e.start));
+		if (e.memory > 0)
+		{
+			fprintf(file, ",\n{\"name\":\"resident memory\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"MB\":%.2f}}",
+			        micro(e.stop), e.memory / 1048576.0);
+		}
+	}
+
+	fprintf(file, "\n]}\n");
+	return fclose(file) == 0;
+}
+
+size_t Profiler::residentMemory()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		return counters.WorkingSetSize;
+	}
+	return 0;
+#elif defined(__linux__)
+	// the second field of statm is the resident size in pages
+	FILE* file = fopen("/proc/self/statm", "r");
+	if (file == nullptr)
+	{
+		return 0;
+	}
+
+	unsigned long size = 0, resident = 0;
+	const int fields = fscanf(file, "%lu %lu", &size, &resident);
+	fclose(file);
+	return fields == 2 ? size_t(resident) * size_t(sysconf(_SC_PAGESIZE)) : 0;
+#else
+	return 0;
+#endif
+}
+
+bool Profiler::isMasterThread()
+{
+#ifdef _OPENMP
+	return omp_get_thread_num() == 0;
+#else
+	return true;
+#endif
+}
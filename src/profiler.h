@@ -0,0 +1,140 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "singleton.h"
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+/**
+ * \brief Timeline of the solver phases, recorded with steady_clock together with the resident
+ * memory of the process at the end of every phase. The phases are recorded through the
+ * PROFILE_ macros below, which compile to nothing unless the build defines CRWCR_PROFILING,
+ * so the profiler costs nothing when disabled. Read it through Singleton<Profiler>.
+ */
+class Profiler
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Event
+	{
+		const char* name;
+		Clock::time_point start, stop;
+		// small thread number in the order threads first recorded
+		int thread;
+		// resident bytes of the process at stop
+		size_t memory;
+	};
+
+	Profiler();
+
+	/**
+	 * \brief whether the build records phases at all
+	 */
+	static bool isEnabled();
+
+	/**
+	 * \brief add a phase that ran from start to stop on the calling thread
+	 * \param name :string literal, kept by pointer
+	 */
+	void record(const char* name, Clock::time_point start, Clock::time_point stop);
+
+	/**
+	 * \brief drop all events and reset the peak memory
+	 */
+	void clear();
+
+	/**
+	 * \brief number of events so far, marks where a solve starts for getSummary
+	 */
+	size_t getNumEvents() const;
+
+	std::vector<Event> getEvents() const;
+
+	/**
+	 * \brief total milliseconds of each phase name over the events from first on, in order of appearance
+	 * \param first
+	 */
+	std::vector<std::pair<std::string, double>> getSummary(size_t first) const;
+
+	/**
+	 * \brief largest resident bytes of the process seen since the last clear
+	 */
+	size_t getPeakMemory() const;
+
+	/**
+	 * \brief write the events as Chrome trace JSON, opened by chrome://tracing and Perfetto.
+	 * Phases become slices on the track of their thread, memory a counter track.
+	 * \param path
+	 * \return false if the file cannot be written
+	 */
+	bool exportTrace(const std::string& path) const;
+
+	/**
+	 * \brief resident bytes of the process now, 0 where the OS does not tell
+	 */
+	static size_t residentMemory();
+
+	/**
+	 * \brief whether the calling thread is the master of its OpenMP team, or there is no team
+	 */
+	static bool isMasterThread();
+
+private:
+	mutable std::mutex mutex_;
+	std::vector<Event> events_;
+	std::vector<std::thread::id> threads_;
+	Clock::time_point origin_;
+	size_t peakMemory_;
+};
+
+
+/**
+ * \brief records the enclosing scope as one phase
+ */
+class ProfileScope
+{
+public:
+	explicit ProfileScope(const char* name) :
+		name_(name),
+		start_(Profiler::Clock::now())
+	{
+	}
+
+	~ProfileScope()
+	{
+		Singleton<Profiler>::GetInstance().record(name_, start_, Profiler::Clock::now());
+	}
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+	const char* name_;
+	Profiler::Clock::time_point start_;
+};
+
+
+#ifdef CRWCR_PROFILING
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+// time the rest of the enclosing scope
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+// start a phase that is recorded later by PROFILE_RECORD, e.g. across an OpenMP worksharing loop
+#define PROFILE_START(var) const Profiler::Clock::time_point var = Profiler::Clock::now()
+#define PROFILE_RECORD(name, var) Singleton<Profiler>::GetInstance().record(name, var, Profiler::Clock::now())
+// record once per parallel region, after a worksharing loop whose barrier all threads have passed
+#define PROFILE_RECORD_MASTER(name, var) if (Profiler::isMasterThread()) PROFILE_RECORD(name, var)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_START(var)
+#define PROFILE_RECORD(name, var)
+#define PROFILE_RECORD_MASTER(name, var)
+#endif
+
+#endif // PROFILER_H
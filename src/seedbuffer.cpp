@@ -0,0 +1,184 @@
+#include "seedbuffer.h"
+#include <cstdlib>
+#include <cstring>
+
+SeedBuffer::SeedBuffer() :
+	seedBuffer_(nullptr),
+	ownsBuffer_(false),
+	width_(0),
+	height_(0)
+{
+}
+
+SeedBuffer::SeedBuffer(unsigned char* labels, int width, int height) :
+	seedBuffer_(labels),
+	ownsBuffer_(false),
+	width_(width),
+	height_(height)
+{
+	updateSpans();
+}
+
+SeedBuffer::~SeedBuffer()
+{
+	release();
+}
+
+void SeedBuffer::allocate(int width, int height)
+{
+	const size_t numPixels = size_t(width) * height;
+	if (!ownsBuffer_ || width != width_ || height != height_)
+	{
+		release();
+
+		seedBuffer_ = new unsigned char[numPixels];
+		ownsBuffer_ = true;
+		width_ = width;
+		height_ = height;
+	}
+
+	memset(seedBuffer_, 0, numPixels);
+	clearSpans();
+}
+
+void SeedBuffer::assign(const unsigned char* labels, int width, int height)
+{
+	const size_t numPixels = size_t(width) * height;
+	if (!ownsBuffer_ || width != width_ || height != height_)
+	{
+		release();
+
+		seedBuffer_ = new unsigned char[numPixels];
+		ownsBuffer_ = true;
+		width_ = width;
+		height_ = height;
+	}
+
+	memcpy(seedBuffer_, labels, numPixels);
+	updateSpans();
+}
+
+void SeedBuffer::wrap(unsigned char* labels, int width, int height)
+{
+	release();
+
+	seedBuffer_ = labels;
+	width_ = width;
+	height_ = height;
+	updateSpans();
+}
+
+void SeedBuffer::updateSpans()
+{
+	clearSpans();
+
+#pragma omp parallel for
+	for (int y = 0; y < height_; y++)
+	{
+		const unsigned char* row = seedBuffer_ + size_t(y) * width_;
+		const unsigned char* last = row + width_;
+		const unsigned char* first = std::find_if(row, last, [](unsigned char label) { return label != 0; });
+		if (first == last)
+		{
+			continue;
+		}
+		while (last[-1] == 0)
+		{
+			last--;
+		}
+		rowSpans_[y] = {int(first - row), int(last - row)};
+	}
+
+	// the column spans are gathered inside the row spans, every thread owns a block of columns
+	const int blockColumns = 256;
+#pragma omp parallel for
+	for (int x0 = 0; x0 < width_; x0 += blockColumns)
+	{
+		const int x1 = std::min(x0 + blockColumns, width_);
+		for (int y = 0; y < height_; y++)
+		{
+			const unsigned char* row = seedBuffer_ + size_t(y) * width_;
+			const int end = std::min(x1, rowSpans_[y].end);
+			for (int x = std::max(x0, rowSpans_[y].begin); x < end; x++)
+			{
+				if (row[x] != 0)
+				{
+					extend(columnSpans_[x], y);
+				}
+			}
+		}
+	}
+}
+
+void SeedBuffer::drawLine(int x0, int y0, int x1, int y1, unsigned char label, SeedRegion& region)
+{
+	// Bresenham
+	const int dx = std::abs(x1 - x0), dy = -std::abs(y1 - y0);
+	const int sx = x0 < x1 ? 1 : -1, sy = y0 < y1 ? 1 : -1;
+	int x = x0, y = y0;
+	int error = dx + dy;
+
+	while (true)
+	{
+		if (x >= 0 && x < width_ && y >= 0 && y < height_)
+		{
+			setLabel(x, y, label);
+
+			region.x0 = std::min(region.x0, x);
+			region.y0 = std::min(region.y0, y);
+			region.x1 = std::max(region.x1, x + 1);
+			region.y1 = std::max(region.y1, y + 1);
+		}
+
+		if (x == x1 && y == y1)
+		{
+			break;
+		}
+
+		const int e2 = 2 * error;
+		if (e2 >= dy)
+		{
+			error += dy;
+			x += sx;
+		}
+		if (e2 <= dx)
+		{
+			error += dx;
+			y += sy;
+		}
+	}
+}
+
+unsigned char* SeedBuffer::getSeedBuffer()
+{
+	return seedBuffer_;
+}
+
+int SeedBuffer::getWidth() const
+{
+	return width_;
+}
+
+int SeedBuffer::getHeight() const
+{
+	return height_;
+}
+
+void SeedBuffer::release()
+{
+	if (ownsBuffer_)
+	{
+		delete[] seedBuffer_;
+	}
+	seedBuffer_ = nullptr;
+	ownsBuffer_ = false;
+	width_ = 0;
+	height_ = 0;
+	clearSpans();
+}
+
+void SeedBuffer::clearSpans()
+{
+	rowSpans_.assign(height_, {width_, 0});
+	columnSpans_.assign(width_, {height_, 0});
+}
@@ -0,0 +1,153 @@
+#ifndef SEEDBUFFER_H
+#define SEEDBUFFER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+
+/**
+ * \brief pixel rectangle [x0, x1) x [y0, y1)
+ */
+struct SeedRegion
+{
+	int x0, y0, x1, y1;
+};
+
+
+/**
+ * \brief extent [begin, end) of the labels along one row or column, empty if begin >= end
+ */
+struct SeedSpan
+{
+	int begin, end;
+};
+
+
+/**
+ * \brief Row-major seed labels of an image, 0: none, otherwise the label, 1 is the foreground
+ * of a two-label solve. The labels are either owned or a caller buffer used in place.
+ * The solver only reads them, it grows the foreground in a copy of its own.
+ *
+ * Every row and column keeps the span of its labels, so the solver can go straight to the
+ * lines with seeds and skip the lookups outside them. The spans cover every label set through
+ * this class, labels written through getSeedBuffer need updateSpans.
+ */
+class SeedBuffer
+{
+public:
+	SeedBuffer();
+
+	/**
+	 * \brief use the caller's labels in place, they are neither copied nor freed
+	 * \param labels :width * height labels, alive as long as the buffer is used
+	 * \param width 
+	 * \param height 
+	 */
+	SeedBuffer(unsigned char* labels, int width, int height);
+
+	~SeedBuffer();
+
+	SeedBuffer(const SeedBuffer&) = delete;
+	SeedBuffer& operator=(const SeedBuffer&) = delete;
+
+	/**
+	 * \brief own a buffer of width * height labels, all 0. An owned buffer of the same size is reused.
+	 */
+	void allocate(int width, int height);
+
+	/**
+	 * \brief own a copy of labels. An owned buffer of the same size is reused.
+	 */
+	void assign(const unsigned char* labels, int width, int height);
+
+	/**
+	 * \brief use the caller's labels in place, see the constructor
+	 */
+	void wrap(unsigned char* labels, int width, int height);
+
+	bool isSeedPoint(size_t index) const
+	{
+		return seedBuffer_[index] > 0;
+	}
+
+	bool isForegroundSeed(size_t index) const
+	{
+		return seedBuffer_[index] == 1;
+	}
+
+	void setToForegroundSeed(size_t index)
+	{
+		setLabel(int(index % width_), int(index / width_), 1);
+	}
+
+	unsigned char getLabel(size_t index) const
+	{
+		return seedBuffer_[index];
+	}
+
+	/**
+	 * \brief label pixel (x, y) and extend its row and column span over it
+	 */
+	void setLabel(int x, int y, unsigned char label)
+	{
+		seedBuffer_[x + size_t(y) * width_] = label;
+		extend(rowSpans_[y], x);
+		extend(columnSpans_[x], y);
+	}
+
+	/**
+	 * \brief label the 8-connected line from (x0, y0) to (x1, y1), clipped to the buffer
+	 * \param region :grown to cover the labeled pixels
+	 */
+	void drawLine(int x0, int y0, int x1, int y1, unsigned char label, SeedRegion& region);
+
+	/**
+	 * \brief span of the labels of row y
+	 */
+	const SeedSpan& getRowSpan(int y) const
+	{
+		return rowSpans_[y];
+	}
+
+	/**
+	 * \brief span of the labels of column x
+	 */
+	const SeedSpan& getColumnSpan(int x) const
+	{
+		return columnSpans_[x];
+	}
+
+	/**
+	 * \brief find the spans again after the labels were written through getSeedBuffer
+	 */
+	void updateSpans();
+
+	unsigned char* getSeedBuffer();
+
+	int getWidth() const;
+
+	int getHeight() const;
+
+private:
+	void release();
+
+	/**
+	 * \brief all spans empty
+	 */
+	void clearSpans();
+
+	static void extend(SeedSpan& span, int i)
+	{
+		span.begin = std::min(span.begin, i);
+		span.end = std::max(span.end, i + 1);
+	}
+
+	unsigned char* seedBuffer_;
+	bool ownsBuffer_;
+	int width_, height_;
+
+	std::vector<SeedSpan> rowSpans_, columnSpans_;
+};
+
+#endif // SEEDBUFFER_H
@@ -7,7 +7,10 @@
  */
 struct Parameters
 {
-	// 1D initialization parameters
+	// edge weight exp(-beta * |normalized intensity difference|)
+	float beta = 80.f;
+
+	// 1D initialization parameters, the growth stops before maxIterations1D once a pass adds no foreground
 	int maxIterations1D = 10;
 	float gamma1D = 0.2f;
 	float lambda1D = 100.f;
@@ -18,6 +21,34 @@ struct Parameters
 	float gamma2D = 0.0006f;
 	float lambda2D = 100.f;
 	float dt = 0.01f;
+	// stop PR once the max-norm change of an iteration drops below, 0 always runs maxIterations2D
+	float tolerance2D = 0.f;
+
+	// coarse-to-fine pyramid, 1 solves at full resolution only
+	int pyramidLevels = 1;
+	// PR iterations on each warm-started finer level
+	int refineIterations2D = 3;
+	// time step of the PR iterations that start from an earlier result instead of the seed mask,
+	// larger than dt so that the edges of the start are not amplified
+	float warmStartDt = 1.f;
+
+	// after a new stroke only re-solve a window around it, starting from the last result
+	bool incremental = false;
+	// pixels the window extends beyond the new stroke on each side
+	int incrementalMargin = 48;
+
+	// show the probability map after the 1D initialization and every PR iteration while solving
+	bool progressive = false;
+
+	// memory for the solver of one tile of a tiled solve or one slab of a volume, which sets the tile size
+	int tileMemoryMB = 1024;
+	// pixels of the neighbouring tiles solved along with a tile
+	int tileHalo = 128;
+	// slices of the neighbouring slabs solved along with a slab of a volume
+	int slabHalo = 8;
+
+	// number of threads used by the PR sweeps, 0 means all available cores
+	int numThreads = 0;
 };
 
 /**
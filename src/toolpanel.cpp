@@ -1,5 +1,6 @@
 #include<QtWidgets>
 #include "toolpanel.h"
+#include "profiler.h"
 
 ToolPanel::ToolPanel(QWidget* parent /*= 0*/, Qt::WindowFlags f /*= 0*/):
 	parameters_(Singleton<Parameters>::GetInstance()),
@@ -11,10 +12,31 @@ ToolPanel::ToolPanel(QWidget* parent /*= 0*/, Qt::WindowFlags f /*= 0*/):
 	createConnect();
 }
 
-void ToolPanel::computeTimeChanged(int time) const
+void ToolPanel::computeTimeChanged(float time) const
 {
-	std::string str = std::to_string(time) + " ms";
-	ui_->computeTime->setText(QString(str.c_str()));
+	ui_->computeTime->setText(QString::number(time, 'f', 1) + " ms");
+}
+
+void ToolPanel::progressChanged(int done, int total) const
+{
+	// total 0: nothing is running
+	ui_->progressBar->setMaximum(std::max(total, 1));
+	ui_->progressBar->setValue(done);
+	ui_->cancelBtn->setEnabled(done < total);
+}
+
+void ToolPanel::profileChanged(int firstEvent) const
+{
+	const Profiler& profiler = Singleton<Profiler>::GetInstance();
+
+	QString text;
+	for (const auto& phase : profiler.getSummary(firstEvent))
+	{
+		text += QString("%1: %2 ms\n").arg(QString::fromStdString(phase.first)).arg(phase.second, 0, 'f', 2);
+	}
+	text += QString("peak memory: %1 MB").arg(profiler.getPeakMemory() / 1048576.0, 0, 'f', 1);
+
+	ui_->profileText->setText(text);
 }
 
 void ToolPanel::initParameters()
@@ -28,8 +50,18 @@ void ToolPanel::initParameters()
 	ui_->dt2D->setValue(parameters_.dt);
 	ui_->gamma2D->setValue(parameters_.gamma2D);
 	ui_->labmda2D->setValue(parameters_.lambda2D);
+	ui_->tolerance2D->setValue(parameters_.tolerance2D);
+	ui_->pyramidLevels->setValue(parameters_.pyramidLevels);
+	ui_->refineIterations2D->setValue(parameters_.refineIterations2D);
+	ui_->incrementalCbox->setChecked(parameters_.incremental);
+	ui_->progressiveCbox->setChecked(parameters_.progressive);
 
 	ui_->computeTime->setText(QString(" "));
+
+	// the phase times are only recorded by profiling builds
+	ui_->profileText->setText(QString());
+	ui_->profileText->setVisible(Profiler::isEnabled());
+	ui_->exportTraceBtn->setVisible(Profiler::isEnabled());
 }
 
 void ToolPanel::createConnect()
@@ -37,10 +69,12 @@ void ToolPanel::createConnect()
 	connect(ui_->preProcessCbox, &QCheckBox::stateChanged, [=](int state) { emit preProcessCheckChanged(state); });
 	connect(ui_->loadBtn, &QPushButton::clicked, [=]() { emit loadImage(); });
 	connect(ui_->computerBtn, &QPushButton::clicked, [=]() { emit computerClicked(); });
+	connect(ui_->cancelBtn, &QPushButton::clicked, [=]() { emit cancelClicked(); });
 	connect(ui_->fRadioButton, &QRadioButton::clicked, [=]() { emit seedModeChanged(1); });
 	connect(ui_->bRadioButton, &QRadioButton::clicked, [=]() { emit seedModeChanged(2); });
 	connect(ui_->noneRadioButton, &QRadioButton::clicked, [=]() { emit seedModeChanged(0); });
 	connect(ui_->clearSeedBtn, &QPushButton::clicked, [=]() { emit clearSeeds(); });
+	connect(ui_->exportTraceBtn, &QPushButton::clicked, [=]() { emit exportTrace(); });
 
 	connect(ui_->iteration1D, qOverload<int>(&QSpinBox::valueChanged),
 	        [=](int value) { parameters_.maxIterations1D = value; });
@@ -60,6 +94,14 @@ void ToolPanel::createConnect()
 	        [=](double value) { parameters_.gamma2D = value; });
 	connect(ui_->labmda2D, qOverload<double>(&QDoubleSpinBox::valueChanged),
 	        [=](double value) { parameters_.lambda2D = value; });
+	connect(ui_->tolerance2D, qOverload<double>(&QDoubleSpinBox::valueChanged),
+	        [=](double value) { parameters_.tolerance2D = value; });
+	connect(ui_->pyramidLevels, qOverload<int>(&QSpinBox::valueChanged),
+	        [=](int value) { parameters_.pyramidLevels = value; });
+	connect(ui_->refineIterations2D, qOverload<int>(&QSpinBox::valueChanged),
+	        [=](int value) { parameters_.refineIterations2D = value; });
+	connect(ui_->incrementalCbox, &QCheckBox::stateChanged, [=](int state) { parameters_.incremental = state > 0; });
+	connect(ui_->progressiveCbox, &QCheckBox::stateChanged, [=](int state) { parameters_.progressive = state > 0; });
 
 	connect(ui_->renderContourThreshold, qOverload<double>(&QDoubleSpinBox::valueChanged),
 	        [=](double value) { emit thresholdChanged(value); });
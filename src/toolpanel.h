@@ -18,6 +18,7 @@ signals:
 	// 0: None, 1:F, 2:B
 	void seedModeChanged(int);
 	void computerClicked();
+	void cancelClicked();
 
 	void loadImage();
 
@@ -28,8 +29,24 @@ signals:
 	void thresholdChanged(double);
 	void preProcessCheckChanged(int);
 
+	void exportTrace();
+
 public slots:
-	void computeTimeChanged(int time) const;
+	void computeTimeChanged(float time) const;
+
+	/**
+	 * \brief show how far the running segmentation is, cancel is offered until done reaches total.
+	 * A total of 0 resets the bar.
+	 * \param done 
+	 * \param total 
+	 */
+	void progressChanged(int done, int total) const;
+
+	/**
+	 * \brief show the time of each phase from the profiler event firstEvent on, and the peak memory
+	 * \param firstEvent 
+	 */
+	void profileChanged(int firstEvent) const;
 
 private:
 
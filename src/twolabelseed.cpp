@@ -1,18 +1,34 @@
 #include "twolabelseed.h"
-#include <fstream>
-#include<cassert>
-#include<QVector2D>
+#include "profiler.h"
+#include<algorithm>
 
-
-TwoLabelSeed::TwoLabelSeed():
-	seedBuffer_(nullptr)
+namespace
 {
+	/**
+	 * \brief whether the bounding box of a stroke meets region
+	 */
+	bool overlaps(const PointSegment& pointList, const SeedRegion& region)
+	{
+		if (pointList.empty())
+		{
+			return false;
+		}
+
+		int x0 = pointList[0].x(), y0 = pointList[0].y(), x1 = x0, y1 = y0;
+		for (const QPoint& point : pointList)
+		{
+			x0 = std::min(x0, point.x());
+			y0 = std::min(y0, point.y());
+			x1 = std::max(x1, point.x());
+			y1 = std::max(y1, point.y());
+		}
+		return x0 < region.x1 && x1 >= region.x0 && y0 < region.y1 && y1 >= region.y0;
+	}
 }
 
-TwoLabelSeed::~TwoLabelSeed()
+
+TwoLabelSeed::TwoLabelSeed()
 {
-	delete[] seedBuffer_;
-	seedBuffer_ = nullptr;
 }
 
 void TwoLabelSeed::setSeeds(const PointListGeometry& foregroundSeed, const PointListGeometry& backgroundSeed)
@@ -21,81 +37,104 @@ void TwoLabelSeed::setSeeds(const PointListGeometry& foregroundSeed, const Point
 	backgroundSeed_ = backgroundSeed;
 }
 
-bool TwoLabelSeed::isSeedPoint(size_t index) const
-{
-	assert(seedBuffer_ != nullptr);
-
-	return seedBuffer_[index] > 0;
-}
-
-bool TwoLabelSeed::isForegroundSeed(size_t index) const
+void TwoLabelSeed::initialize(QSize dim)
 {
-	assert(seedBuffer_ != nullptr);
+	PROFILE_SCOPE("seed rasterization");
 
-	return seedBuffer_[index] == 1;
-}
+	allocate(dim.width(), dim.height());
 
-void TwoLabelSeed::setToForegroundSeed(size_t index)
-{
-	assert(seedBuffer_ != nullptr);
+	SeedRegion region = {dim.width(), dim.height(), 0, 0};
+	rasterize(foregroundSeed_, 0, 1, *this, region);
+	rasterize(backgroundSeed_, 0, 2, *this, region);
 
-	seedBuffer_[index] = 1;
+	rasterizedForeground_ = foregroundSeed_;
+	rasterizedBackground_ = backgroundSeed_;
 }
 
-void TwoLabelSeed::initialize(QSize dim)
+bool TwoLabelSeed::update(QSize dim, SeedRegion& region)
 {
-	delete[] seedBuffer_;
-	seedBuffer_ = new unsigned char[dim.width() * dim.height()];
-	memset(seedBuffer_, 0, dim.width() * dim.height());
+	PROFILE_SCOPE("seed rasterization");
 
-	for (size_t i = 0; i < foregroundSeed_.getSegmentNums(); i++)
+	if (getSeedBuffer() == nullptr || dim != QSize(getWidth(), getHeight()) ||
+		!startsWith(foregroundSeed_, rasterizedForeground_) || !startsWith(backgroundSeed_, rasterizedBackground_))
 	{
-		auto pointList = foregroundSeed_.getSegment(i);
+		return false;
+	}
 
-		if (pointList.empty())
-			continue;
+	region = {dim.width(), dim.height(), 0, 0};
+	rasterize(foregroundSeed_, rasterizedForeground_.getSegmentNums(), 1, *this, region);
 
-		for (size_t j = 0; j < pointList.size() - 1; j++)
+	// initialize draws the background last, so the old background strokes the new foreground may
+	// have crossed are drawn again. Their pixels outside region are background already.
+	if (region.x0 < region.x1)
+	{
+		const SeedRegion foreground = region;
+		SeedRegion redrawn = region;
+		for (size_t i = 0; i < rasterizedBackground_.getSegmentNums(); i++)
 		{
-			QVector2D left = QVector2D(pointList.at(j));
-			QVector2D right = QVector2D(pointList.at(j + 1));
-			QVector2D dir = right - left;
-			QVector2D d = dir.normalized();
-
-			for (float t = 0; t < dir.length(); t += 1.f)
+			const PointSegment& pointList = rasterizedBackground_.getSegment(int(i));
+			if (overlaps(pointList, foreground))
 			{
-				auto p = left + d * t;
-				size_t index = int(p.x()) + dim.width() * (int(p.y()));
-				seedBuffer_[index] = 1;
+				drawSegment(pointList, 2, *this, redrawn);
 			}
 		}
 	}
 
-	for (size_t i = 0; i < backgroundSeed_.getSegmentNums(); i++)
+	rasterize(backgroundSeed_, rasterizedBackground_.getSegmentNums(), 2, *this, region);
+
+	rasterizedForeground_ = foregroundSeed_;
+	rasterizedBackground_ = backgroundSeed_;
+	return true;
+}
+
+void TwoLabelSeed::rasterize(const PointListGeometry& seed, size_t firstSegment, unsigned char label, SeedBuffer& buffer,
+                             SeedRegion& region)
+{
+	for (size_t i = firstSegment; i < seed.getSegmentNums(); i++)
 	{
-		auto pointList = backgroundSeed_.getSegment(i);
+		drawSegment(seed.getSegment(int(i)), label, buffer, region);
+	}
+}
 
-		if (pointList.empty())
-			continue;
+void TwoLabelSeed::drawSegment(const PointSegment& pointList, unsigned char label, SeedBuffer& buffer,
+                               SeedRegion& region)
+{
+	if (pointList.empty())
+	{
+		return;
+	}
 
-		for (size_t j = 0; j < pointList.size() - 1; j++)
-		{
-			QVector2D left = QVector2D(pointList.at(j));
-			QVector2D right = QVector2D(pointList.at(j + 1));
-			QVector2D dir = right - left;
-			QVector2D d = dir.normalized();
+	// a line from every point to the next, a single point is a line to itself
+	const size_t numLines = std::max(pointList.size(), size_t(2)) - 1;
+	for (size_t j = 0; j < numLines; j++)
+	{
+		const QPoint& from = pointList[j];
+		const QPoint& to = pointList[std::min(j + 1, pointList.size() - 1)];
+		buffer.drawLine(from.x(), from.y(), to.x(), to.y(), label, region);
+	}
+}
 
-			for (float t = 0; t < dir.length(); t += 1.f)
-			{
-				auto p = left + d * t;
-				size_t index = int(p.x()) + dim.width() * (int(p.y()));
-				seedBuffer_[index] = 2;
-			}
+bool TwoLabelSeed::startsWith(const PointListGeometry& seed, const PointListGeometry& prefix)
+{
+	if (seed.getSegmentNums() < prefix.getSegmentNums())
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < prefix.getSegmentNums(); i++)
+	{
+		if (seed.getSegment(i) != prefix.getSegment(i))
+		{
+			return false;
 		}
 	}
+	return true;
 }
 
-unsigned char* TwoLabelSeed::getSeedBuffer()
+void TwoLabelSeed::initialize(const unsigned char* labels, QSize dim)
 {
-	return seedBuffer_;
+	assign(labels, dim.width(), dim.height());
+
+	rasterizedForeground_.clear();
+	rasterizedBackground_.clear();
 }
@@ -2,34 +2,68 @@
 #define TWOLABELSEED_H
 
 #include"pointlistgeometry.h"
+#include "seedbuffer.h"
 #include<QSize>
 
 
 /**
- * \brief 
+ * \brief foreground and background strokes drawn into a seed buffer
  */
-class TwoLabelSeed
+class TwoLabelSeed : public SeedBuffer
 {
 public:
 	TwoLabelSeed();
-	~TwoLabelSeed();
 
 	void setSeeds(const PointListGeometry& foregroundSeed, const PointListGeometry& backgroundSeed);
 
-	bool isSeedPoint(size_t index) const;
-
-	bool isForegroundSeed(size_t index) const;
+	void initialize(QSize dim);
 
-	void setToForegroundSeed(size_t index);
+	/**
+	 * \brief initialize from an existing label buffer, 0: none, 1: foreground, 2: background
+	 * \param labels 
+	 * \param dim 
+	 */
+	void initialize(const unsigned char* labels, QSize dim);
 
-	void initialize(QSize dim);
+	/**
+	 * \brief rasterize only the strokes appended since the last initialize/update, keeping the
+	 * strokes already drawn. The labels are those initialize draws, background wins where a new
+	 * foreground stroke crosses an old background one.
+	 * \param dim 
+	 * \param region :bounding box of the new seed pixels, empty if nothing was added
+	 * \return false if strokes were removed or changed, or the size changed; initialize is needed then
+	 */
+	bool update(QSize dim, SeedRegion& region);
 
-	unsigned char* getSeedBuffer();
+	/**
+	 * \brief draw the strokes of seed from firstSegment on into a label buffer, as 8-connected lines
+	 * clipped to the buffer
+	 * \param seed 
+	 * \param firstSegment 
+	 * \param label 
+	 * \param buffer 
+	 * \param region :grown to cover the drawn pixels
+	 */
+	static void rasterize(const PointListGeometry& seed, size_t firstSegment, unsigned char label, SeedBuffer& buffer,
+	                      SeedRegion& region);
 
 private:
 
-	unsigned char* seedBuffer_;
+	/**
+	 * \brief draw one stroke, see rasterize
+	 */
+	static void drawSegment(const PointSegment& pointList, unsigned char label, SeedBuffer& buffer,
+	                        SeedRegion& region);
+
+	/**
+	 * \brief whether all strokes already in the buffer are still the leading strokes of seed
+	 */
+	static bool startsWith(const PointListGeometry& seed, const PointListGeometry& prefix);
+
 	PointListGeometry foregroundSeed_, backgroundSeed_;
+
+	// strokes present in the seed buffer
+	PointListGeometry rasterizedForeground_, rasterizedBackground_;
 };
 
 #endif // TWOLABELSEED_H
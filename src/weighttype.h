@@ -0,0 +1,13 @@
+#ifndef WEIGHTTYPE_H
+#define WEIGHTTYPE_H
+
+#include "half.h"
+
+#ifdef CRWCR_COMPACT_MEMORY
+// edge weights and gradient in half precision
+typedef Half WeightType;
+#else
+typedef float WeightType;
+#endif
+
+#endif // WEIGHTTYPE_H
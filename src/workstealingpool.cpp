@@ -0,0 +1,69 @@
+#include "workstealingpool.h"
+#include <thread>
+#include <algorithm>
+
+WorkStealingPool::WorkStealingPool(int numThreads) :
+	numThreads_(numThreads > 0 ? numThreads : std::max(1, int(std::thread::hardware_concurrency()))),
+	queues_(numThreads_)
+{
+}
+
+void WorkStealingPool::run(size_t numTasks, const std::function<void(size_t, int)>& task)
+{
+	for (size_t i = 0; i < numTasks; i++)
+	{
+		queues_[i % numThreads_].tasks.push_back(i);
+	}
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < numThreads_; t++)
+	{
+		threads.emplace_back([this, t, &task]()
+		{
+			size_t index;
+			while (next(t, index))
+			{
+				task(index, t);
+			}
+		});
+	}
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+int WorkStealingPool::getNumThreads() const
+{
+	return numThreads_;
+}
+
+bool WorkStealingPool::next(int thread, size_t& index)
+{
+	{
+		Queue& own = queues_[thread];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty())
+		{
+			index = own.tasks.front();
+			own.tasks.pop_front();
+			return true;
+		}
+	}
+
+	// tasks are never added while running, so one round over the other queues is enough
+	for (int i = 1; i < numThreads_; i++)
+	{
+		Queue& victim = queues_[(thread + i) % numThreads_];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty())
+		{
+			index = victim.tasks.back();
+			victim.tasks.pop_back();
+			return true;
+		}
+	}
+
+	return false;
+}
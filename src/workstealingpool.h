@@ -0,0 +1,49 @@
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <functional>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+
+/**
+ * \brief Runs a fixed set of independent tasks on a group of threads. The tasks are dealt out
+ * round-robin to a queue per thread; a thread works from the front of its own queue and, once
+ * it is empty, steals from the back of the others, so long tasks do not hold up the rest.
+ */
+class WorkStealingPool
+{
+public:
+	/**
+	 * \param numThreads :0 means one per core
+	 */
+	explicit WorkStealingPool(int numThreads);
+
+	/**
+	 * \brief run task(index, thread) for every index in [0, numTasks) and wait for all of them
+	 * \param numTasks
+	 * \param task
+	 */
+	void run(size_t numTasks, const std::function<void(size_t, int)>& task);
+
+	int getNumThreads() const;
+
+private:
+	/**
+	 * \brief next task of thread: its own front, otherwise the back of another queue
+	 * \return false once all queues are empty
+	 */
+	bool next(int thread, size_t& index);
+
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<size_t> tasks;
+	};
+
+	int numThreads_;
+	std::vector<Queue> queues_;
+};
+
+#endif // WORKSTEALINGPOOL_H